@@ -18,6 +18,9 @@ public:
 
     virtual void animate(unsigned round) = 0;
 
+    /// The entity moved, called with the queued movements from the entity store
+    virtual void move(const point &from, const point &to) = 0;
+
     virtual point getPixelPosition() const = 0;
 
     virtual ImageEntry getFrame() const = 0;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <cstdint>
 
 class IEntity;
 class ILevel;
@@ -17,3 +18,34 @@ public:
     static std::unique_ptr<IBehavior> fromEntity(std::shared_ptr<ILevel> level, std::shared_ptr<IEntity> entity);
     static std::unique_ptr<IBehavior> fromLevel(std::shared_ptr<ILevel> level);
 };
+
+/**
+ * The behavior of all entities in a level. The traits are stored and run per
+ * trait type, and each type in bottom-up, left-to-right order of the entities.
+ */
+class IEntityBehaviors
+{
+public:
+    virtual ~IEntityBehaviors()
+    {
+    }
+
+    /// Entities added while running start with the next run
+    virtual void addEntity(std::shared_ptr<IEntity> entity) = 0;
+
+    virtual void removeEntity(uint32_t id) = 0;
+
+    virtual void run(unsigned ms) = 0;
+
+    /**
+     * Work out what many traits of a type will do at once, before running
+     * them. On by default, and doesn't change the outcome.
+     */
+    virtual void setBulkPlanning(bool enabled) = 0;
+
+    /**
+     * With more than one thread, parts of the traits are prepared on worker
+     * threads. The outcome is the same as with a single thread.
+     */
+    static std::unique_ptr<IEntityBehaviors> create(std::shared_ptr<ILevel> level, unsigned threads = 1);
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <point.hh>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * One bit per level cell, stored row by row in 64-bit words so that rules
+ * can be evaluated for 64 cells at a time. Bit x of word w in a row is the
+ * cell at x + 64 * w. Bits outside the level are always 0.
+ */
+class Bitboard
+{
+public:
+    Bitboard() = default;
+
+    Bitboard(const extents &size)
+    {
+        resize(size);
+    }
+
+    /// Resize and clear all bits
+    void resize(const extents &size)
+    {
+        m_size = size;
+        m_wordsPerRow = (size.width + 63) / 64;
+        m_words.assign(m_wordsPerRow * size.height, 0);
+    }
+
+    const extents &getSize() const
+    {
+        return m_size;
+    }
+
+    size_t getWordsPerRow() const
+    {
+        return m_wordsPerRow;
+    }
+
+    bool test(const point &where) const
+    {
+        if (!inside(where))
+        {
+            return false;
+        }
+
+        return (m_words[where.y * m_wordsPerRow + where.x / 64] >> (where.x % 64)) & 1;
+    }
+
+    /// Outside the level, this does nothing
+    void set(const point &where, bool value)
+    {
+        if (!inside(where))
+        {
+            return;
+        }
+
+        auto &word = m_words[where.y * m_wordsPerRow + where.x / 64];
+        auto bit = 1ULL << (where.x % 64);
+
+        word = value ? (word | bit) : (word & ~bit);
+    }
+
+    /// The words of row @a y, or nullptr outside the level
+    const uint64_t *row(int y) const
+    {
+        if (y < 0 || y >= (int)m_size.height)
+        {
+            return nullptr;
+        }
+
+        return &m_words[y * m_wordsPerRow];
+    }
+
+    uint64_t *row(int y)
+    {
+        if (y < 0 || y >= (int)m_size.height)
+        {
+            return nullptr;
+        }
+
+        return &m_words[y * m_wordsPerRow];
+    }
+
+    /// Word @a w of @a row, with each bit holding the cell to the left of it
+    static uint64_t fromLeft(const uint64_t *row, size_t w)
+    {
+        return (row[w] << 1) | (w > 0 ? row[w - 1] >> 63 : 0);
+    }
+
+    /// Word @a w of @a row, with each bit holding the cell to the right of it
+    static uint64_t fromRight(const uint64_t *row, size_t w, size_t words)
+    {
+        return (row[w] >> 1) | (w + 1 < words ? row[w + 1] << 63 : 0);
+    }
+
+private:
+    bool inside(const point &where) const
+    {
+        return where.x >= 0 && where.y >= 0 && where.x < (int)m_size.width && where.y < (int)m_size.height;
+    }
+
+    extents m_size;
+    size_t m_wordsPerRow{0};
+    std::vector<uint64_t> m_words;
+};
@@ -26,5 +26,8 @@ public:
 
     virtual std::shared_ptr<IProperties> fromEntity(std::shared_ptr<IEntity> entity) = 0;
 
+    /// Forget the properties of a destroyed entity
+    virtual void removeEntity(uint32_t id) = 0;
+
     static std::shared_ptr<IEntityProperties> getInstance();
 };
@@ -2,11 +2,12 @@
 
 #include <vector>
 #include <memory>
+#include <optional>
+#include <cstdint>
 
 #include <observer.hh>
-
-struct point;
-enum class Direction;
+#include <point.hh>
+#include <neighborhood.hh>
 
 enum class EntityType
 {
@@ -22,6 +23,61 @@ enum class EntityType
 	FIREBALL,
 };
 
+// The number of entity types
+constexpr unsigned ENTITY_TYPE_COUNT = (unsigned)EntityType::FIREBALL + 1;
+
+// What an entity type is like, as bits in ENTITY_ATTRIBUTES
+enum EntityAttribute : uint8_t
+{
+	ENTITY_ROUNDED   = 1 << 0, // Falling objects roll off it
+	ENTITY_CRUSHABLE = 1 << 1, // Destroyed when something falls on it
+	ENTITY_PUSHABLE  = 1 << 2, // The player can push it sideways
+	ENTITY_GLOWING   = 1 << 3, // A light source
+};
+
+// Indexed by EntityType
+constexpr uint8_t ENTITY_ATTRIBUTES[] =
+{
+	ENTITY_ROUNDED | ENTITY_PUSHABLE,                   // BOULDER
+	0,                                                  // BLOCK
+	ENTITY_CRUSHABLE,                                   // GHOST
+	ENTITY_CRUSHABLE,                                   // PLAYER
+	ENTITY_ROUNDED,                                     // DIAMOND
+	ENTITY_ROUNDED | ENTITY_CRUSHABLE | ENTITY_GLOWING, // BOMB
+	0,                                                  // IRON_KEY
+	0,                                                  // GOLD_KEY
+	0,                                                  // RED_KEY
+	ENTITY_GLOWING,                                     // FIREBALL
+};
+static_assert(sizeof(ENTITY_ATTRIBUTES) == ENTITY_TYPE_COUNT, "One entry per entity type");
+
+/// True if @a type has all of @a attributes
+constexpr bool entityHas(EntityType type, uint8_t attributes)
+{
+	return (ENTITY_ATTRIBUTES[(unsigned)type] & attributes) == attributes;
+}
+
+// Where to create an entity, for batch creation
+struct EntitySpawn
+{
+	EntityType type;
+	point where;
+};
+
+// Queued world events, see IEntityStore::setEventQueueing
+struct MovementEvent
+{
+	uint32_t id;
+	point from;
+	point to;
+};
+
+struct CollisionEvent
+{
+	uint32_t one; // The entity which moved (or was created)
+	uint32_t other;
+};
+
 class IEntity
 {
 public:
@@ -42,17 +98,19 @@ public:
 	virtual uint32_t getId() const = 0;
 
 
+	/// Remove the entity from the store. Removal listeners run when the store destroys it.
 	virtual void remove() = 0;
 
-	virtual std::unique_ptr<ObserverCookie> onRemoval(std::function<void(std::shared_ptr<IEntity>)> cb) = 0;
+	virtual std::unique_ptr<ObserverCookie> onRemoval(std::function<void(const std::shared_ptr<IEntity> &)> cb) = 0;
 
-    virtual std::unique_ptr<ObserverCookie> onMovement(std::function<void(std::shared_ptr<IEntity>,
+    virtual std::unique_ptr<ObserverCookie> onMovement(std::function<void(const std::shared_ptr<IEntity> &,
             const point &from, const point &to)> cb) = 0;
 
 
     // Creation etc
 	static std::shared_ptr<IEntity> createFromChar(char c, const point &where);
 	static std::shared_ptr<IEntity> createFromType(EntityType type, const point &where);
+	static std::optional<EntityType> typeFromChar(char c);
 	static bool isValid(char c);
 };
 
@@ -66,13 +124,85 @@ public:
 
     virtual std::vector<std::shared_ptr<IEntity>> getEntities() = 0;
 
+    /**
+     * Visit all entities, or all entities of a type, without copying them. The
+     * visitor must not create or remove entities.
+     */
+    virtual void forEachEntity(const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor) = 0;
+
+    virtual void forEachOfType(EntityType type, const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor) = 0;
+
+    /// Visit the entities within a rectangle, starting at @a topLeft
+    virtual void queryRect(const point &topLeft, const extents &size,
+        const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor) = 0;
+
+    /// Visit the entities within @a radius of @a center (inclusive)
+    virtual void queryRadius(const point &center, unsigned radius,
+        const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor) = 0;
+
     virtual std::shared_ptr<IEntity> getEntityByPoint(const point &where) = 0;
 
     virtual std::shared_ptr<IEntity> getEntityById(uint32_t id) = 0;
 
-    virtual std::unique_ptr<ObserverCookie> onCreation(std::function<void(std::shared_ptr<IEntity> entity)> cb) = 0;
-
-    virtual std::unique_ptr<ObserverCookie> onCollision(std::function<void(std::shared_ptr<IEntity> one, std::shared_ptr<IEntity> other)> cb) = 0;
+    /**
+     * Size the occupancy grid for a level, with the entities already in the
+     * store. Those which don't fit are removed. Placing an entity outside of
+     * the grid throws std::out_of_range.
+     */
+    virtual void setSize(const extents &size) = 0;
+
+    /// Fill in the entities around @a center, leaving the tiles as they are
+    virtual void getNeighborhood(const point &center, Neighborhood<1> &out) const = 0;
+    virtual void getNeighborhood(const point &center, Neighborhood<2> &out) const = 0;
+
+    /**
+     * Create many entities at once. Collisions are resolved in a single pass, and
+     * the entities which remain are reported through onBatchCreation (not onCreation).
+     */
+    virtual std::vector<std::shared_ptr<IEntity>> spawnBatch(const std::vector<EntitySpawn> &spawns) = 0;
+
+    virtual std::unique_ptr<ObserverCookie> onCreation(std::function<void(const std::shared_ptr<IEntity> &entity)> cb) = 0;
+
+    virtual std::unique_ptr<ObserverCookie> onBatchCreation(std::function<void(const std::vector<std::shared_ptr<IEntity>> &entities)> cb) = 0;
+
+    virtual std::unique_ptr<ObserverCookie> onCollision(std::function<void(const std::shared_ptr<IEntity> &one, const std::shared_ptr<IEntity> &other)> cb) = 0;
+
+    /**
+     * Called right away when what getEntityByPoint returns for a point might have
+     * changed, i.e., when entities are created, move or are removed.
+     */
+    virtual std::unique_ptr<ObserverCookie> onOccupancyChange(std::function<void(const point &where)> cb) = 0;
+
+    /**
+     * Destroy the entities removed since the last call. Removed entities are gone
+     * from lookups right away, but their removal listeners and onDestruction only
+     * run from here, typically once at the end of each tick.
+     */
+    virtual void destroyRemoved() = 0;
+
+    virtual std::unique_ptr<ObserverCookie> onDestruction(std::function<void(const std::vector<uint32_t> &ids)> cb) = 0;
+
+    /**
+     * Queue movements and collisions until dispatchEvents() instead of reporting
+     * collisions from setPosition. The occupancy is still updated right away.
+     * Off by default; turning it off dispatches what's queued.
+     */
+    virtual void setEventQueueing(bool queue) = 0;
+
+    /**
+     * Report the queued events in bulk, first the movements and then the
+     * collisions. Events queued by the listeners are dispatched as well.
+     */
+    virtual void dispatchEvents() = 0;
+
+    /// Queued movements, only reported when queueing
+    virtual std::unique_ptr<ObserverCookie> onMovements(std::function<void(const std::vector<MovementEvent> &events)> cb) = 0;
+
+    /**
+     * Collisions in bulk. Without queueing, each collision is reported on its own.
+     * The entities might have been removed by earlier events in the batch.
+     */
+    virtual std::unique_ptr<ObserverCookie> onCollisions(std::function<void(const std::vector<CollisionEvent> &events)> cb) = 0;
 
 	static std::shared_ptr<IEntityStore> getInstance();
 };
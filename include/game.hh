@@ -2,6 +2,9 @@
 
 #include <string>
 #include <memory>
+#include <functional>
+
+#include <observer.hh>
 
 class IGame
 {
@@ -10,6 +13,19 @@ public:
 
     virtual bool play() = 0;
 
+    /// The number of threads to simulate levels set after this with
+    virtual void setThreads(unsigned threads) = 0;
+
+    /// Called after each game tick, with the number of ticks played so far
+    virtual std::unique_ptr<ObserverCookie> onTick(std::function<void(unsigned tick)> cb) = 0;
+
 
     static std::shared_ptr<IGame> create();
+
+    /**
+     * Create a game which doesn't display anything or wait between ticks. Time
+     * is counted in game ticks, and play() returns after @a maxTicks ticks (0 means
+     * no limit).
+     */
+    static std::shared_ptr<IGame> createHeadless(unsigned maxTicks);
 };
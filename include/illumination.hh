@@ -0,0 +1,63 @@
+#pragma once
+
+#include <point.hh>
+
+#include <bitset>
+
+/**
+ * The points lit by a light at @a origin, as one bit per point in the square
+ * of radius RADIUS around it. The light cone never reaches further than that.
+ */
+struct Illumination
+{
+    static const int RADIUS = 4;
+    static const int SIDE = 2 * RADIUS + 1;
+
+    static bool inWindow(int dx, int dy)
+    {
+        return dx >= -RADIUS && dx <= RADIUS && dy >= -RADIUS && dy <= RADIUS;
+    }
+
+    static unsigned bitOf(int dx, int dy)
+    {
+        return (dy + RADIUS) * SIDE + dx + RADIUS;
+    }
+
+    bool isLit(const point &where) const
+    {
+        auto dx = where.x - origin.x;
+        auto dy = where.y - origin.y;
+
+        return inWindow(dx, dy) && lit.test(bitOf(dx, dy));
+    }
+
+    /// @a where must be within RADIUS of the origin
+    void set(const point &where)
+    {
+        lit.set(bitOf(where.x - origin.x, where.y - origin.y));
+    }
+
+    size_t count() const
+    {
+        return lit.count();
+    }
+
+    /// Visit the lit points, ordered by row and then column
+    template<typename Fn>
+    void forEach(Fn fn) const
+    {
+        for (int dy = -RADIUS; dy <= RADIUS; dy++)
+        {
+            for (int dx = -RADIUS; dx <= RADIUS; dx++)
+            {
+                if (lit.test(bitOf(dx, dy)))
+                {
+                    fn(point{origin.x + dx, origin.y + dy});
+                }
+            }
+        }
+    }
+
+    point origin;
+    std::bitset<SIDE * SIDE> lit;
+};
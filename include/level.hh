@@ -2,12 +2,16 @@
 
 #include "tile.hh"
 #include "point.hh"
+#include "observer.hh"
+#include "neighborhood.hh"
+#include "illumination.hh"
 
 #include <string>
 #include <memory>
 #include <vector>
 #include <set>
 #include <optional>
+#include <functional>
 
 class IEntity;
 
@@ -24,12 +28,20 @@ public:
 
 	virtual void setTile(const point &where, TileType what) = 0;
 
+	/// Fill in the tiles around @a center, leaving the entities as they are
+	virtual void getNeighborhood(const point &center, Neighborhood<1> &out) const = 0;
+	virtual void getNeighborhood(const point &center, Neighborhood<2> &out) const = 0;
+
 	virtual void explode(const point &where) = 0;
 
+	/// Called when a tile changes, through setTile or an explosion
+	virtual std::unique_ptr<ObserverCookie> onTileChange(std::function<void(const point &where)> cb) = 0;
+
 	/**
-	 * Get the flashlight cone from a point
+	 * Get the flashlight cone from a point. Cheap when neither the point, the
+	 * direction nor the translucency of the tiles around it has changed.
 	 */
-	virtual std::set<point> getIllumination(const point &where, Direction dir) = 0;
+	virtual Illumination getIllumination(const point &where, Direction dir) = 0;
 
 	virtual std::string toString() const = 0;
 
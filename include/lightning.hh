@@ -3,6 +3,7 @@
 #include <point.hh>
 #include <entity.hh>
 #include <level.hh>
+#include <bitboard.hh>
 
 #include <optional>
 #include <memory>
@@ -18,6 +19,9 @@ public:
     };
 
 
+    /// The light level of a tile which is fully lit by light sources
+    static constexpr unsigned LIGHT_FULL = 3;
+
     struct ShadowEntity
     {
         point pt;
@@ -28,15 +32,31 @@ public:
     {
     }
 
-    virtual void updateLightning(const std::set<point> &lighted) = 0;
+    virtual void updateLightning(const Illumination &lighted) = 0;
 
     virtual std::optional<TileType> tileAt(const point &where) const = 0;
 
-    virtual const std::set<point> getLighted() const = 0;
+    /**
+     * The tiles in the light right now, and the ones which have been at some
+     * point. Updated in place, so they can be scanned row by row without copying.
+     */
+    virtual const Bitboard &getLit() const = 0;
+    virtual const Bitboard &getSeen() const = 0;
+
+    virtual bool isLit(const point &where) const = 0;
+
+    virtual bool isSeen(const point &where) const = 0;
+
+    /**
+     * How much the light sources, such as fireballs and bombs, light up a tile:
+     * from 0 for not at all to LIGHT_FULL. Updated with the lightning.
+     */
+    virtual unsigned getLightLevel(const point &where) const = 0;
 
     /// Return the entity ID:s which are visible
     virtual const std::vector<uint32_t> &getVisibleEntities() = 0;
-    virtual std::vector<ShadowEntity> getShadowEntities() = 0;
+    /// Entities last seen, or known to be, where it's dark. Updated in place
+    virtual const std::vector<ShadowEntity> &getShadowEntities() = 0;
 
 	virtual void setUnknownBehavior(const UnknownBehavior &what) = 0;
 
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <tile.hh>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+enum class EntityType;
+
+/**
+ * The tiles and entities in the square of radius @a R around a point, fetched
+ * in one go from the level and the entity store. Cells are addressed by their
+ * offset from the center, and cells outside the level have neither a tile
+ * nor an entity.
+ */
+template<int R>
+struct Neighborhood
+{
+    static const int SIDE = 2 * R + 1;
+    static const uint8_t NONE = 0xff; // No tile (outside) or no entity
+
+    struct Cell
+    {
+        uint8_t tile{NONE};   // TileType
+        uint8_t entity{NONE}; // EntityType
+        uint32_t id{0};       // Of the entity, 0 for none
+    };
+
+    Cell &at(int dx, int dy)
+    {
+        return cells[(dy + R) * SIDE + dx + R];
+    }
+
+    const Cell &at(int dx, int dy) const
+    {
+        return cells[(dy + R) * SIDE + dx + R];
+    }
+
+    /// Like ILevel::tileAt
+    std::optional<TileType> tileAt(int dx, int dy) const
+    {
+        auto tile = at(dx, dy).tile;
+
+        if (tile == NONE)
+        {
+            return std::nullopt;
+        }
+
+        return (TileType)tile;
+    }
+
+    bool hasEntity(int dx, int dy) const
+    {
+        return at(dx, dy).entity != NONE;
+    }
+
+    /// Only valid if hasEntity()
+    EntityType entityAt(int dx, int dy) const
+    {
+        return (EntityType)at(dx, dy).entity;
+    }
+
+    std::array<Cell, SIDE * SIDE> cells;
+};
@@ -2,12 +2,15 @@
 
 #include <memory>
 #include <functional>
-#include <unordered_map>
-#include <vector>
+#include <algorithm>
+#include <array>
+#include <deque>
+
+#include <pool.hh>
 
 class NotifierBase;
 
-class ObserverCookie
+class ObserverCookie : public PoolAllocated
 {
 public:
     ObserverCookie(uint32_t id, std::weak_ptr<NotifierBase> notifier) :
@@ -35,142 +38,179 @@ protected:
     virtual void detach(uint32_t id) = 0;
 };
 
-template<typename FN>
+/**
+ * The listeners of a notifier. The first few are kept inline, so most
+ * notifiers never allocate for their listeners. Listeners can be added and
+ * removed while invoking.
+ */
+template<typename... Args>
 class NotifierContainer : public NotifierBase
 {
 public:
-    std::unique_ptr<ObserverCookie> listen(FN &cb)
+    using Callback = std::function<void(const Args &...)>;
+
+    std::unique_ptr<ObserverCookie> listen(Callback &&cb)
     {
-        auto id = (uint32_t)m_listeners.size();
+        // Never reused, so a stale cookie can't detach someone else
+        auto id = m_nextId++;
+
+        auto it = std::find_if(m_inline.begin(), m_inline.end(), [](const Listener &cur)
+        {
+            return cur.id == 0 && !cur.cb;
+        });
 
-        m_listeners[id] = cb;
+        if (it != m_inline.end())
+        {
+            it->id = id;
+            it->cb = std::move(cb);
+        }
+        else
+        {
+            m_overflow.push_back({id, std::move(cb)});
+        }
 
         return std::make_unique<ObserverCookie>(id, shared_from_this());
     }
 
-    void detach(uint32_t id) override
+    void invoke(const Args &... args)
     {
-        if (m_invoking)
+        m_depth++;
+
+        for (auto &cur : m_inline)
         {
-            // We can't remove while iterating, so put in a list for later removal
-            m_entriesToRemove.push_back(id);
+            if (cur.id)
+            {
+                cur.cb(args...);
+            }
         }
-        else
+
+        // Index based, since listeners might be added from the callbacks. The
+        // deque keeps the running callback in place while they are
+        for (size_t i = 0, n = m_overflow.size(); i < n; i++)
         {
-            m_listeners.erase(id);
+            if (m_overflow[i].id)
+            {
+                m_overflow[i].cb(args...);
+            }
         }
-    }
 
-    bool m_invoking{false};
-    std::unordered_map<uint32_t, FN> m_listeners;
-    std::vector<uint32_t> m_entriesToRemove;
-};
-
-template<typename FN>
-class NotifierBasex
-{
-public:
-    std::unique_ptr<ObserverCookie> listen(FN cb)
-    {
-        return m_impl->listen(cb);
+        m_depth--;
+        if (m_depth == 0 && m_detached)
+        {
+            purge();
+        }
     }
 
-protected:
-    NotifierBasex() : m_impl(std::make_shared<NotifierContainer<FN>>())
+    void detach(uint32_t id) override
     {
-    }
+        auto listener = find(id);
 
-    void doInvoke(std::function<void()> wrapped)
-    {
-        m_impl->m_invoking = true;
-        wrapped();
-        m_impl->m_invoking = false;
-        for (auto it : m_impl->m_entriesToRemove)
+        if (!listener)
         {
-            m_impl->detach(it);
+            return;
+        }
+
+        // Can't destroy callbacks while they might be running, so just mark it for now
+        listener->id = 0;
+        m_detached = true;
+
+        if (m_depth == 0)
+        {
+            purge();
         }
-        m_impl->m_entriesToRemove.clear();
     }
 
-    std::shared_ptr<NotifierContainer<FN>> m_impl;
-};
+private:
+    static const unsigned INLINE_LISTENERS = 2;
 
-class Notifier0 : public NotifierBasex<std::function<void()>>
-{
-public:
-    void operator()()
+    struct Listener
     {
-        invoke();
-    }
+        uint32_t id{0}; // 0 for unused
+        Callback cb;
+    };
 
-    void invoke()
+    Listener *find(uint32_t id)
     {
-        for (auto &kv : m_impl->m_listeners)
+        for (auto &cur : m_inline)
+        {
+            if (cur.id == id)
+            {
+                return &cur;
+            }
+        }
+        for (auto &cur : m_overflow)
         {
-            kv.second();
+            if (cur.id == id)
+            {
+                return &cur;
+            }
         }
-    }
-};
 
-template<typename A0>
-class Notifier1 : public NotifierBasex<std::function<void(A0)>>
-{
-public:
-    void operator()(A0 arg0)
-    {
-        invoke(arg0);
+        return nullptr;
     }
 
-    void invoke(A0 arg0)
+    void purge()
     {
-        NotifierBasex<std::function<void(A0)>>::doInvoke([this, arg0]()
+        for (auto &cur : m_inline)
         {
-            for (auto &kv : NotifierBasex<std::function<void(A0)>>::m_impl->m_listeners)
+            if (cur.id == 0)
             {
-                kv.second(arg0);
+                cur.cb = nullptr;
             }
-        });
+        }
+
+        m_overflow.erase(std::remove_if(m_overflow.begin(), m_overflow.end(), [](const Listener &cur)
+        {
+            return cur.id == 0;
+        }), m_overflow.end());
+
+        m_detached = false;
     }
+
+    std::array<Listener, INLINE_LISTENERS> m_inline;
+    std::deque<Listener> m_overflow;
+    uint32_t m_nextId{1};
+    unsigned m_depth{0};
+    bool m_detached{false};
 };
 
-template<typename A0, typename A1>
-class Notifier2 : public NotifierBasex<std::function<void(A0, A1)>>
+template<typename... Args>
+class Notifier
 {
 public:
-    void operator()(A0 arg0, A1 arg1)
+    using Callback = typename NotifierContainer<Args...>::Callback;
+
+    Notifier() :
+        m_impl(std::allocate_shared<NotifierContainer<Args...>>(PoolAllocator<NotifierContainer<Args...>>()))
     {
-        invoke(arg0, arg1);
     }
 
-    void invoke(A0 arg0, A1 arg1)
+    std::unique_ptr<ObserverCookie> listen(Callback cb)
     {
-        NotifierBasex<std::function<void(A0, A1)>>::doInvoke([this, arg0, arg1]()
-        {
-            for (auto &kv : NotifierBasex<std::function<void(A0, A1)>>::m_impl->m_listeners)
-            {
-                kv.second(arg0, arg1);
-            }
-        });
+        return m_impl->listen(std::move(cb));
     }
-};
 
-template<typename A0, typename A1, typename A2>
-class Notifier3 : public NotifierBasex<std::function<void(A0, A1, A2)>>
-{
-public:
-    void operator()(A0 arg0, A1 arg1, A2 arg2)
+    void operator()(const Args &... args)
     {
-        invoke(arg0, arg1, arg2);
+        invoke(args...);
     }
 
-    void invoke(A0 arg0, A1 arg1, A2 arg2)
+    void invoke(const Args &... args)
     {
-        NotifierBasex<std::function<void(A0, A1, A2)>>::doInvoke([this, arg0, arg1, arg2]()
-        {
-            for (auto &kv : NotifierBasex<std::function<void(A0, A1, A2)>>::m_impl->m_listeners)
-            {
-                kv.second(arg0, arg1, arg2);
-            }
-        });
+        m_impl->invoke(args...);
     }
+
+private:
+    std::shared_ptr<NotifierContainer<Args...>> m_impl;
 };
+
+using Notifier0 = Notifier<>;
+
+template<typename A0>
+using Notifier1 = Notifier<A0>;
+
+template<typename A0, typename A1>
+using Notifier2 = Notifier<A0, A1>;
+
+template<typename A0, typename A1, typename A2>
+using Notifier3 = Notifier<A0, A1, A2>;
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/**
+ * Fixed-size block pools for frequently created objects (entities, behaviors,
+ * traits, animators). Blocks are carved from slabs and recycled through a
+ * free list, so steady-state allocations don't reach malloc. Not thread-safe.
+ */
+class BlockPool
+{
+public:
+    struct Stats
+    {
+        uint64_t hits{0};   // Served without going to malloc
+        uint64_t misses{0}; // Needed a new slab, or too large for the pools
+        uint64_t slabs{0};  // Slabs allocated
+    };
+
+    void *allocate();
+
+    void deallocate(void *p);
+
+
+    /// Allocate/free memory of any size, from the pool for its size class if small enough
+    static void *allocate(std::size_t size);
+    static void deallocate(void *p, std::size_t size);
+
+    /// Accumulated stats for all pools
+    static Stats getStats();
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    static BlockPool *forSize(std::size_t size);
+
+    void refill();
+
+    std::size_t m_blockSize{0};
+    FreeBlock *m_free{nullptr};
+    Stats m_stats;
+};
+
+/// Base class for objects allocated through the block pools with new/delete
+class PoolAllocated
+{
+public:
+    static void *operator new(std::size_t size)
+    {
+        return BlockPool::allocate(size);
+    }
+
+    static void operator delete(void *p, std::size_t size)
+    {
+        BlockPool::deallocate(p, size);
+    }
+};
+
+/// Allocator for std::allocate_shared and containers
+template<typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U> &other)
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(BlockPool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        BlockPool::deallocate(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U> &other) const
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const PoolAllocator<U> &other) const
+    {
+        return false;
+    }
+};
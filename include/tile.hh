@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 
 enum class TileType
 {
@@ -15,3 +16,40 @@ enum class TileType
 	EXIT,
 	UNKNOWN,
 };
+
+// The number of tile types
+constexpr unsigned TILE_TYPE_COUNT = (unsigned)TileType::UNKNOWN + 1;
+
+// What a tile type allows, as bits in TILE_ATTRIBUTES
+enum TileAttribute : uint8_t
+{
+	TILE_PASSABLE    = 1 << 0, // The player can walk here
+	TILE_DIGGABLE    = 1 << 1, // Dug away (to EMPTY) by the player
+	TILE_WALKABLE    = 1 << 2, // Ghosts can walk, and boulders be pushed, here
+	TILE_OPEN        = 1 << 3, // Nothing in the way for falling or transported objects
+	TILE_TRANSLUCENT = 1 << 4, // Light passes through
+	TILE_BLAST_PROOF = 1 << 5, // Stops explosions
+};
+
+// Indexed by TileType
+constexpr uint8_t TILE_ATTRIBUTES[] =
+{
+	TILE_PASSABLE | TILE_WALKABLE | TILE_OPEN | TILE_TRANSLUCENT, // EMPTY
+	TILE_PASSABLE | TILE_DIGGABLE | TILE_TRANSLUCENT,             // DIRT
+	0,                                                            // MAGIC_WALL
+	0,                                                            // LEFT_TRANSPORT
+	0,                                                            // RIGHT_TRANSPORT
+	TILE_BLAST_PROOF,                                             // STONE_WALL
+	0,                                                            // WEAK_STONE_WALL
+	TILE_PASSABLE | TILE_WALKABLE,                                // TELEPORTER
+	0,                                                            // CONVEYOR
+	0,                                                            // EXIT
+	0,                                                            // UNKNOWN
+};
+static_assert(sizeof(TILE_ATTRIBUTES) == TILE_TYPE_COUNT, "One entry per tile type");
+
+/// True if @a type has all of @a attributes
+constexpr bool tileHas(TileType type, uint8_t attributes)
+{
+	return (TILE_ATTRIBUTES[(unsigned)type] & attributes) == attributes;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Hierarchical timer wheel. Scheduling is O(1), and advancing only touches the
+ * timers which expire or move down a level, so waiting timers cost nothing.
+ *
+ * Timers can't be cancelled: the owner checks if the value is still of
+ * interest when it expires. Timers expiring at the same time come out in
+ * no particular order.
+ */
+template<typename T>
+class TimerWheel
+{
+public:
+    void schedule(uint64_t deadline, const T &value)
+    {
+        // Already due, so expire at the next advance
+        insert(std::max(deadline, m_now + 1), value);
+    }
+
+    /// Advance the time to @a now, and add the values of the expired timers to @a expired
+    void advance(uint64_t now, std::vector<T> &expired)
+    {
+        while (m_now < now)
+        {
+            if (m_size == 0)
+            {
+                m_now = now;
+                break;
+            }
+
+            // Jump to the next timer on the lowest level, but stop at the next
+            // boundary to move timers down from the higher levels
+            auto next = std::min((m_now | SLOT_MASK) + 1, now);
+            for (auto cur = m_now + 1; cur < next; cur++)
+            {
+                if (!m_slots[0][cur & SLOT_MASK].empty())
+                {
+                    next = cur;
+                    break;
+                }
+            }
+            m_now = next;
+
+            // Move timers down before looking at the lowest level
+            unsigned top = 0;
+            while (top + 1 < LEVELS && ((m_now >> (SLOT_BITS * (top + 1))) << (SLOT_BITS * (top + 1))) == m_now)
+            {
+                top++;
+            }
+            if (top == LEVELS - 1 && (m_now & ((1ULL << (SLOT_BITS * LEVELS)) - 1)) == 0)
+            {
+                reschedule(m_overflow);
+            }
+            for (unsigned level = top; level > 0; level--)
+            {
+                reschedule(m_slots[level][(m_now >> (SLOT_BITS * level)) & SLOT_MASK]);
+            }
+
+            auto &slot = m_slots[0][m_now & SLOT_MASK];
+            for (auto &cur : slot)
+            {
+                expired.push_back(cur.value);
+            }
+            m_size -= slot.size();
+            slot.clear();
+        }
+    }
+
+    uint64_t now() const
+    {
+        return m_now;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    static const unsigned SLOT_BITS = 6;
+    static const unsigned SLOTS = 1U << SLOT_BITS;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+    static const unsigned LEVELS = 4;
+
+    struct Timer
+    {
+        uint64_t deadline;
+        T value;
+    };
+
+    // @a deadline is now at the earliest, when moving timers down
+    void insert(uint64_t deadline, const T &value)
+    {
+        auto delta = deadline - m_now;
+
+        for (unsigned level = 0; level < LEVELS; level++)
+        {
+            if (delta < (1ULL << (SLOT_BITS * (level + 1))))
+            {
+                m_slots[level][(deadline >> (SLOT_BITS * level)) & SLOT_MASK].push_back({deadline, value});
+                m_size++;
+
+                return;
+            }
+        }
+
+        m_overflow.push_back({deadline, value});
+        m_size++;
+    }
+
+    void reschedule(std::vector<Timer> &timers)
+    {
+        if (timers.empty())
+        {
+            return;
+        }
+
+        std::vector<Timer> cur;
+
+        std::swap(cur, timers);
+        m_size -= cur.size();
+        for (auto &it : cur)
+        {
+            insert(it.deadline, it.value);
+        }
+    }
+
+    uint64_t m_now{0};
+    size_t m_size{0};
+    std::array<std::array<std::vector<Timer>, SLOTS>, LEVELS> m_slots;
+
+    // Too far into the future for the wheel
+    std::vector<Timer> m_overflow;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+/**
+ * A fixed set of worker threads for splitting work into stripes. The calling
+ * thread takes part as well, so a pool of one thread runs everything inline.
+ *
+ * The jobs must not touch the block pools or the notifiers, which are not
+ * thread-safe.
+ */
+class IWorkerPool
+{
+public:
+    virtual ~IWorkerPool()
+    {
+    }
+
+    /// The number of threads, including the calling one
+    virtual unsigned getThreadCount() const = 0;
+
+    /**
+     * Split [0, count) into one contiguous stripe per thread, and call @a job
+     * with each. Returns when all stripes are done.
+     */
+    virtual void forEachStripe(size_t count, const std::function<void(size_t first, size_t last)> &job) = 0;
+
+    static std::unique_ptr<IWorkerPool> create(unsigned threads);
+};
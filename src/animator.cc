@@ -5,10 +5,11 @@
 #include <entity.hh>
 
 #include <resource-store.hh>
+#include <pool.hh>
 
 #include <list>
 
-class Animator : public IAnimator
+class Animator : public IAnimator, public PoolAllocated
 {
 public:
     Animator(Image frame, std::shared_ptr<IEntity> entity, int width, unsigned nFrames, int nRounds) :
@@ -19,10 +20,11 @@ public:
         m_nFrames(nFrames),
         m_nRounds(nRounds)
     {
-        m_movementCookie = m_entity->onMovement([this](std::shared_ptr<IEntity> entity, const point &from, const point &to)
-        {
-            handleMovement(from, to);
-        });
+    }
+
+    void move(const point &from, const point &to) override
+    {
+        handleMovement(from, to);
     }
 
     virtual void animate(unsigned round) override
@@ -93,7 +95,6 @@ protected:
     const unsigned m_nFrames;
     const int m_nRounds;
 
-    std::unique_ptr<ObserverCookie> m_movementCookie;
     std::list<FrameHandler> m_frameHandlers;
 };
 
@@ -2,14 +2,23 @@
 
 #include <level.hh>
 #include <entity.hh>
+#include <pool.hh>
+#include <timer-wheel.hh>
+#include <worker-pool.hh>
 
 #include <list>
 #include <map>
+#include <tuple>
+#include <algorithm>
+#include <type_traits>
+#include <optional>
+#include <unordered_map>
 
 #include <stdlib.h>
 
 // Ok, not very nice perhaps
 #include "traits/falling.cc"
+#include "traits/falling-kernel.cc"
 #include "traits/exploding.cc"
 #include "traits/disappear-after.cc"
 #include "traits/ghost-exploring.cc"
@@ -20,67 +29,665 @@
 #include "traits/transporter-bands.cc"
 #include "traits/teleporting.cc"
 
-class Behavior : public IBehavior
+template<typename... Traits>
+struct TraitList
 {
-public:
-    Behavior(std::shared_ptr<ILevel> level, std::shared_ptr<IEntity> entity);
+};
 
-    void run(unsigned ms) override;
+// The traits of each entity type, in the order they run
+template<EntityType Type>
+struct TraitsOf
+{
+    using type = TraitList<>;
+};
 
-private:
-    std::vector<std::unique_ptr<ITrait>> m_traits;
+template<>
+struct TraitsOf<EntityType::BOULDER>
+{
+    using type = TraitList<FallTrait>;
 };
 
-class LevelBehavior : public IBehavior
+template<>
+struct TraitsOf<EntityType::DIAMOND>
 {
-public:
-    LevelBehavior(std::shared_ptr<ILevel> level);
+    using type = TraitList<FallTrait>;
+};
 
-    void run(unsigned ms) override;
+template<>
+struct TraitsOf<EntityType::BOMB>
+{
+    using type = TraitList<FallTrait, ExplodeAfterTrait>;
+};
 
-private:
-    std::vector<std::unique_ptr<ITrait>> m_traits;
+template<>
+struct TraitsOf<EntityType::FIREBALL>
+{
+    using type = TraitList<FallTrait, DisappearAfterTrait>;
+};
+
+template<>
+struct TraitsOf<EntityType::GHOST>
+{
+    using type = TraitList<GhostWalkingTrait>;
 };
 
+template<>
+struct TraitsOf<EntityType::PLAYER>
+{
+    using type = TraitList<player::Walk, player::Operate>;
+};
+
+template<typename Trait>
+static Trait makeTrait(const std::shared_ptr<ILevel> &level, const std::shared_ptr<IEntity> &entity)
+{
+    return Trait(level, entity);
+}
+
+template<>
+ExplodeAfterTrait makeTrait<ExplodeAfterTrait>(const std::shared_ptr<ILevel> &level, const std::shared_ptr<IEntity> &entity)
+{
+    return ExplodeAfterTrait(2000, level, entity);
+}
 
+template<>
+DisappearAfterTrait makeTrait<DisappearAfterTrait>(const std::shared_ptr<ILevel> &level, const std::shared_ptr<IEntity> &entity)
+{
+    return DisappearAfterTrait(1000, entity);
+}
 
-Behavior::Behavior(std::shared_ptr<ILevel> level, std::shared_ptr<IEntity> entity)
+// Call fn() with the TraitList of @a type, turning the type into a compile-time one
+template<typename Fn>
+static auto withTraitsOf(EntityType type, Fn fn)
 {
-    switch (entity->getType())
+    switch (type)
     {
     case EntityType::BOULDER:
-        m_traits.push_back(std::unique_ptr<ITrait>(new FallTrait(level, entity)));
-        break;
+        return fn(TraitsOf<EntityType::BOULDER>::type());
     case EntityType::DIAMOND:
-        m_traits.push_back(std::unique_ptr<ITrait>(new FallTrait(level, entity)));
-        break;
+        return fn(TraitsOf<EntityType::DIAMOND>::type());
     case EntityType::BOMB:
-        m_traits.push_back(std::unique_ptr<ITrait>(new FallTrait(level, entity)));
-        m_traits.push_back(std::unique_ptr<ITrait>(new ExplodeAfterTrait(2000, level, entity)));
-        break;
+        return fn(TraitsOf<EntityType::BOMB>::type());
     case EntityType::FIREBALL:
-        m_traits.push_back(std::unique_ptr<ITrait>(new FallTrait(level, entity)));
-        m_traits.push_back(std::unique_ptr<ITrait>(new DisappearAfterTrait(1000, entity)));
-        break;
+        return fn(TraitsOf<EntityType::FIREBALL>::type());
     case EntityType::GHOST:
-        m_traits.push_back(std::unique_ptr<ITrait>(new GhostWalkingTrait(level, entity)));
-        break;
+        return fn(TraitsOf<EntityType::GHOST>::type());
     case EntityType::PLAYER:
-        m_traits.push_back(std::unique_ptr<ITrait>(new player::Walk(level, entity)));
-        m_traits.push_back(std::unique_ptr<ITrait>(new player::Operate(level, entity)));
-        break;
+        return fn(TraitsOf<EntityType::PLAYER>::type());
     default:
         break;
     }
+
+    return fn(TraitList<>());
 }
 
-void Behavior::run(unsigned ms)
+// The traits of one entity, stored inline so the whole update can be inlined
+template<typename... Traits>
+class Behavior : public IBehavior, public PoolAllocated
 {
-    for (auto &trait : m_traits)
+public:
+    Behavior(const std::shared_ptr<ILevel> &level, const std::shared_ptr<IEntity> &entity) :
+        m_traits{makeTrait<Traits>(level, entity)...}
+    {
+    }
+
+    void run(unsigned ms) override
     {
         // FIXME! Maybe do something about the return value
-        trait->run(ms);
+        std::apply([ms](auto &... trait)
+        {
+            (runTrait(trait, ms), ...);
+        }, m_traits);
+    }
+
+private:
+    template<typename Trait>
+    static void runTrait(Trait &trait, unsigned ms)
+    {
+        // The type is known, so no need for a virtual call
+        trait.Trait::run(ms);
+    }
+
+    std::tuple<Traits...> m_traits;
+};
+
+class LevelBehavior : public IBehavior, public PoolAllocated
+{
+public:
+    LevelBehavior(std::shared_ptr<ILevel> level);
+
+    void run(unsigned ms) override;
+
+private:
+    std::vector<std::unique_ptr<ITrait>> m_traits;
+};
+
+// Traits which only look at the 3x3 neighborhood of their entity, and return
+// false from run() when nothing happened. These sleep after an idle run, until
+// something nearby changes.
+template<typename Trait>
+struct CanSleep : std::false_type
+{
+};
+
+template<>
+struct CanSleep<FallTrait> : std::true_type
+{
+};
+
+// Sleeping traits which can split run() into a read-only plan() and apply().
+// When many are awake, a Planner works out the plans of all of them at once
+// before running, and the plans are applied in scan order unless something
+// changed nearby meanwhile. Then the trait is run as usual, so the outcome is
+// the same as without planning.
+struct NoPlanner
+{
+};
+
+template<typename Trait>
+struct CanPlan : std::false_type
+{
+    using Planner = NoPlanner;
+    using Intent = bool;
+};
+
+template<>
+struct CanPlan<FallTrait> : std::true_type
+{
+    using Planner = FallKernel;
+    using Intent = FallTrait::Intent;
+};
+
+// Traits which only do something when their time is up. These are kept in a
+// timer wheel instead of running every tick, and expire() is called when
+// getTimeLeft() has passed.
+template<typename Trait>
+struct IsTimed : std::false_type
+{
+};
+
+template<>
+struct IsTimed<ExplodeAfterTrait> : std::true_type
+{
+};
+
+template<>
+struct IsTimed<DisappearAfterTrait> : std::true_type
+{
+};
+
+// All traits of one type, stored by value so they run from contiguous memory
+template<typename Trait>
+class TraitGroup
+{
+public:
+    void setLevel(const std::shared_ptr<ILevel> &level)
+    {
+        auto &size = level->getSize();
+
+        if (CanSleep<Trait>::value)
+        {
+            m_size = size;
+            m_sleepers.assign(size.width * size.height, 0);
+        }
+        if constexpr (CanPlan<Trait>::value)
+        {
+            m_planner = std::make_unique<typename CanPlan<Trait>::Planner>(level);
+            m_changedAt.assign(size.width * size.height, 0);
+        }
+    }
+
+    void setWorkers(IWorkerPool *workers)
+    {
+        m_workers = workers;
+    }
+
+    void setPlanning(bool enabled)
+    {
+        m_planning = enabled;
+    }
+
+    void add(const std::shared_ptr<IEntity> &entity, Trait &&trait)
+    {
+        uint32_t index;
+
+        if (!m_free.empty())
+        {
+            index = m_free.back();
+            m_free.pop_back();
+        }
+        else
+        {
+            index = (uint32_t)m_entries.size();
+            m_entries.emplace_back();
+        }
+
+        auto &entry = m_entries[index];
+
+        entry.id = entity->getId();
+        entry.entity = entity;
+        entry.trait.emplace(std::move(trait));
+
+        m_indexById[entry.id] = index;
+
+        if constexpr (IsTimed<Trait>::value)
+        {
+            m_timers.schedule(m_now + std::max(entry.trait->getTimeLeft(), 0), entry.id);
+        }
+        else
+        {
+            m_order.push_back({entity->getPosition(), entry.id, index});
+        }
+    }
+
+    void remove(const std::vector<uint32_t> &ids)
+    {
+        std::vector<uint32_t> freed;
+
+        for (auto id : ids)
+        {
+            auto it = m_indexById.find(id);
+
+            if (it == m_indexById.end())
+            {
+                continue;
+            }
+
+            auto &entry = m_entries[it->second];
+
+            if (entry.asleep)
+            {
+                *sleeperAt(entry.sleepingAt) = 0;
+                entry.asleep = false;
+            }
+            entry.trait.reset();
+            entry.entity.reset();
+
+            freed.push_back(it->second);
+            m_indexById.erase(it);
+        }
+
+        if (freed.empty())
+        {
+            return;
+        }
+
+        // Drop the removed ones before the entries can be reused
+        m_order.erase(std::remove_if(m_order.begin(), m_order.end(), [this](const Order &cur)
+        {
+            return !m_entries[cur.index].trait;
+        }), m_order.end());
+        m_free.insert(m_free.end(), freed.begin(), freed.end());
+    }
+
+    void run(unsigned ms)
+    {
+        if constexpr (IsTimed<Trait>::value)
+        {
+            runTimers(ms);
+            return;
+        }
+
+        sort();
+        plan();
+
+        m_running = true;
+        m_next.clear();
+
+        // Merge the awake traits with those woken up further on during the run
+        size_t i = 0;
+        while (true)
+        {
+            Order cur;
+            bool planned = false;
+
+            if (!m_woken.empty() && (i == m_order.size() || scanOrder(m_woken.front(), m_order[i])))
+            {
+                std::pop_heap(m_woken.begin(), m_woken.end(), runsLater);
+                cur = m_woken.back();
+                m_woken.pop_back();
+            }
+            else if (i < m_order.size())
+            {
+                planned = i < m_plans.size() && !changedAt(m_order[i].where);
+                cur = m_order[i++];
+            }
+            else
+            {
+                break;
+            }
+
+            m_cursor = cur;
+
+            bool active;
+
+            if constexpr (CanPlan<Trait>::value)
+            {
+                active = planned ?
+                    m_entries[cur.index].trait->apply(m_plans[i - 1]) :
+                    m_entries[cur.index].trait->Trait::run(ms);
+            }
+            else
+            {
+                // The type is known, so no need for a virtual call
+                active = m_entries[cur.index].trait->Trait::run(ms);
+            }
+
+            if (active || !sleep(cur.index))
+            {
+                m_next.push_back(cur);
+            }
+        }
+
+        m_running = false;
+        m_plans.clear();
+        std::swap(m_order, m_next);
     }
+
+    // Something changed at @a where, so wake up the sleepers next to it
+    void wake(const point &where)
+    {
+        if (!CanSleep<Trait>::value)
+        {
+            return;
+        }
+
+        for (int y = where.y - 1; y <= where.y + 1; y++)
+        {
+            for (int x = where.x - 1; x <= where.x + 1; x++)
+            {
+                if (!m_plans.empty())
+                {
+                    // The plans made here are stale now
+                    markChanged({x, y});
+                }
+
+                auto cell = sleeperAt({x, y});
+
+                if (!cell || *cell == 0)
+                {
+                    continue;
+                }
+
+                auto index = *cell - 1;
+                auto &entry = m_entries[index];
+                Order order = {entry.sleepingAt, entry.id, index};
+
+                *cell = 0;
+                entry.asleep = false;
+
+                if (!m_running)
+                {
+                    m_order.push_back(order);
+                }
+                else if (scanOrder(m_cursor, order))
+                {
+                    // Would have run after the change anyway, so run it this time
+                    m_woken.push_back(order);
+                    std::push_heap(m_woken.begin(), m_woken.end(), runsLater);
+                }
+                else
+                {
+                    // Ran before the change, and was idle then
+                    m_next.push_back(order);
+                }
+            }
+        }
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t id{0};
+        std::shared_ptr<IEntity> entity;
+        std::optional<Trait> trait; // Empty when removed
+        bool asleep{false};
+        point sleepingAt;
+    };
+
+    struct Order
+    {
+        point where; // At the last sort
+        uint32_t id;
+        uint32_t index; // In m_entries
+    };
+
+    // Bottom-up, left to right. The id breaks ties, since removed entities can overlap
+    static bool scanOrder(const Order &a, const Order &b)
+    {
+        if (a.where.y != b.where.y)
+        {
+            return a.where.y > b.where.y;
+        }
+        if (a.where.x != b.where.x)
+        {
+            return a.where.x < b.where.x;
+        }
+
+        return a.id < b.id;
+    }
+
+    // For a min-heap in scan order
+    static bool runsLater(const Order &a, const Order &b)
+    {
+        return scanOrder(b, a);
+    }
+
+    void sort()
+    {
+        for (auto &cur : m_order)
+        {
+            cur.where = m_entries[cur.index].entity->getPosition();
+        }
+
+        // Usually only a few have moved since the last tick
+        if (!std::is_sorted(m_order.begin(), m_order.end(), scanOrder))
+        {
+            std::sort(m_order.begin(), m_order.end(), scanOrder);
+        }
+    }
+
+    void plan()
+    {
+        if constexpr (CanPlan<Trait>::value)
+        {
+            if (!m_planning || m_order.size() < MIN_PLANNED)
+            {
+                return;
+            }
+
+            // A new generation, instead of clearing the changes from the last run
+            if (++m_generation == 0)
+            {
+                std::fill(m_changedAt.begin(), m_changedAt.end(), 0);
+                m_generation = 1;
+            }
+
+            // The rows with something awake, bottom-up like the traits
+            m_rows.clear();
+            for (auto &cur : m_order)
+            {
+                if (m_rows.empty() || m_rows.back() != cur.where.y)
+                {
+                    m_rows.push_back(cur.where.y);
+                }
+            }
+            m_planner->prepare(m_rows, m_workers);
+
+            m_plans.resize(m_order.size());
+            for (size_t i = 0; i < m_order.size(); i++)
+            {
+                auto &cur = m_order[i];
+
+                m_plans[i] = m_planner->intentAt(cur.where, m_entries[cur.index].trait->isFalling());
+            }
+        }
+    }
+
+    bool changedAt(const point &where) const
+    {
+        if (where.x < 0 || where.y < 0 || where.x >= (int)m_size.width || where.y >= (int)m_size.height)
+        {
+            return true;
+        }
+
+        return m_changedAt[where.y * m_size.width + where.x] == m_generation;
+    }
+
+    void markChanged(const point &where)
+    {
+        if (where.x < 0 || where.y < 0 || where.x >= (int)m_size.width || where.y >= (int)m_size.height)
+        {
+            return;
+        }
+
+        m_changedAt[where.y * m_size.width + where.x] = m_generation;
+    }
+
+    void runTimers(unsigned ms)
+    {
+        m_now += ms;
+        m_expired.clear();
+        m_timers.advance(m_now, m_expired);
+
+        m_next.clear();
+        for (auto id : m_expired)
+        {
+            auto it = m_indexById.find(id);
+
+            // Removed meanwhile
+            if (it != m_indexById.end())
+            {
+                m_next.push_back({m_entries[it->second].entity->getPosition(), id, it->second});
+            }
+        }
+
+        // In scan order, like the others
+        std::sort(m_next.begin(), m_next.end(), scanOrder);
+        for (auto &cur : m_next)
+        {
+            m_entries[cur.index].trait->expire();
+        }
+    }
+
+    bool sleep(uint32_t index)
+    {
+        if (!CanSleep<Trait>::value)
+        {
+            return false;
+        }
+
+        auto &entry = m_entries[index];
+        auto where = entry.entity->getPosition();
+        auto cell = sleeperAt(where);
+
+        // Outside the level, or someone already sleeps there
+        if (!cell || *cell)
+        {
+            return false;
+        }
+
+        *cell = index + 1;
+        entry.asleep = true;
+        entry.sleepingAt = where;
+
+        return true;
+    }
+
+    uint32_t *sleeperAt(const point &where)
+    {
+        if (where.x < 0 || where.y < 0 || where.x >= (int)m_size.width || where.y >= (int)m_size.height)
+        {
+            return nullptr;
+        }
+
+        return &m_sleepers[where.y * m_size.width + where.x];
+    }
+
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_free;
+    std::unordered_map<uint32_t, uint32_t> m_indexById;
+
+    // The awake traits, in scan order after sorting
+    std::vector<Order> m_order;
+
+    // Sleeping entry index + 1 per level position, 0 for none
+    std::vector<uint32_t> m_sleepers;
+    extents m_size{0, 0};
+
+    bool m_running{false};
+    Order m_cursor{};
+    std::vector<Order> m_woken;
+    std::vector<Order> m_next;
+
+    // Below this, planning costs more than it saves
+    static const size_t MIN_PLANNED = 256;
+
+    // For planning traits, the plans of m_order and the run they are valid for
+    IWorkerPool *m_workers{nullptr};
+    bool m_planning{true};
+    std::unique_ptr<typename CanPlan<Trait>::Planner> m_planner;
+    std::vector<typename CanPlan<Trait>::Intent> m_plans;
+    std::vector<int> m_rows;
+    std::vector<uint32_t> m_changedAt;
+    uint32_t m_generation{0};
+
+    // For timed traits, in ms since the group was created
+    uint64_t m_now{0};
+    TimerWheel<uint32_t> m_timers;
+    std::vector<uint32_t> m_expired;
+};
+
+class EntityBehaviors : public IEntityBehaviors
+{
+public:
+    EntityBehaviors(std::shared_ptr<ILevel> level, unsigned threads);
+
+    void addEntity(std::shared_ptr<IEntity> entity) override;
+
+    void removeEntity(uint32_t id) override;
+
+    void run(unsigned ms) override;
+
+    void setBulkPlanning(bool enabled) override;
+
+private:
+    std::shared_ptr<ILevel> m_level;
+    std::unique_ptr<IWorkerPool> m_workers;
+
+    // In the order they run
+    std::tuple<
+        TraitGroup<FallTrait>,
+        TraitGroup<ExplodeAfterTrait>,
+        TraitGroup<DisappearAfterTrait>,
+        TraitGroup<GhostWalkingTrait>,
+        TraitGroup<player::Walk>,
+        TraitGroup<player::Operate>
+    > m_groups;
+
+    bool m_running{false};
+    std::vector<std::shared_ptr<IEntity>> m_pending;
+    std::vector<uint32_t> m_removed;
+
+    std::unique_ptr<ObserverCookie> m_tileCookie;
+    std::unique_ptr<ObserverCookie> m_occupancyCookie;
+};
+
+
+
+template<typename... Traits, typename Fn>
+static void addTraits(TraitList<Traits...>, const std::shared_ptr<ILevel> &level, const std::shared_ptr<IEntity> &entity, Fn &add)
+{
+    (add(makeTrait<Traits>(level, entity)), ...);
+}
+
+// Call add() with each trait of the entity, in the order they run
+template<typename Fn>
+static void createTraits(std::shared_ptr<ILevel> level, std::shared_ptr<IEntity> entity, Fn add)
+{
+    withTraitsOf(entity->getType(), [&level, &entity, &add](auto list)
+    {
+        addTraits(list, level, entity, add);
+    });
 }
 
 LevelBehavior::LevelBehavior(std::shared_ptr<ILevel> level)
@@ -98,12 +705,110 @@ void LevelBehavior::run(unsigned ms)
     }
 }
 
+EntityBehaviors::EntityBehaviors(std::shared_ptr<ILevel> level, unsigned threads) :
+    m_level(level)
+{
+    if (threads > 1)
+    {
+        m_workers = IWorkerPool::create(threads);
+    }
+
+    std::apply([this](auto &... group)
+    {
+        (group.setLevel(m_level), ...);
+        (group.setWorkers(m_workers.get()), ...);
+    }, m_groups);
+
+    auto wake = [this](const point &where)
+    {
+        std::apply([&where](auto &... group)
+        {
+            (group.wake(where), ...);
+        }, m_groups);
+    };
+
+    m_tileCookie = m_level->onTileChange(wake);
+    m_occupancyCookie = IEntityStore::getInstance()->onOccupancyChange(wake);
+}
+
+void EntityBehaviors::addEntity(std::shared_ptr<IEntity> entity)
+{
+    if (m_running)
+    {
+        // Adding would move the traits which are running
+        m_pending.push_back(entity);
+        return;
+    }
+
+    createTraits(m_level, entity, [this, &entity](auto &&trait)
+    {
+        using Trait = std::decay_t<decltype(trait)>;
+
+        std::get<TraitGroup<Trait>>(m_groups).add(entity, std::move(trait));
+    });
+}
+
+void EntityBehaviors::removeEntity(uint32_t id)
+{
+    // Dropped at the start of the next run
+    m_removed.push_back(id);
+}
+
+void EntityBehaviors::run(unsigned ms)
+{
+    if (!m_removed.empty())
+    {
+        std::apply([this](auto &... group)
+        {
+            (group.remove(m_removed), ...);
+        }, m_groups);
+        m_removed.clear();
+    }
+
+    m_running = true;
+    std::apply([ms](auto &... group)
+    {
+        (group.run(ms), ...);
+    }, m_groups);
+    m_running = false;
+
+    std::vector<std::shared_ptr<IEntity>> pending;
+
+    std::swap(pending, m_pending);
+    for (auto &it : pending)
+    {
+        addEntity(it);
+    }
+}
+
+void EntityBehaviors::setBulkPlanning(bool enabled)
+{
+    std::apply([enabled](auto &... group)
+    {
+        (group.setPlanning(enabled), ...);
+    }, m_groups);
+}
+
+template<typename... Traits>
+static std::unique_ptr<IBehavior> makeBehavior(TraitList<Traits...>, const std::shared_ptr<ILevel> &level, const std::shared_ptr<IEntity> &entity)
+{
+    return std::unique_ptr<IBehavior>(new Behavior<Traits...>(level, entity));
+}
+
 std::unique_ptr<IBehavior> IBehavior::fromEntity(std::shared_ptr<ILevel> level, std::shared_ptr<IEntity> entity)
 {
-    return std::unique_ptr<IBehavior>(new Behavior(level, entity));
+    return withTraitsOf(entity->getType(), [&level, &entity](auto list)
+    {
+        return makeBehavior(list, level, entity);
+    });
 }
 
 std::unique_ptr<IBehavior> IBehavior::fromLevel(std::shared_ptr<ILevel> level)
 {
     return std::unique_ptr<IBehavior>(new LevelBehavior(level));
 }
+
+std::unique_ptr<IEntityBehaviors> IEntityBehaviors::create(std::shared_ptr<ILevel> level, unsigned threads)
+{
+    return std::make_unique<EntityBehaviors>(level, threads);
+}
@@ -50,6 +50,11 @@ public:
         return m_entityProperties[id];
     }
 
+    void removeEntity(uint32_t id) override
+    {
+        m_entityProperties.erase(id);
+    }
+
 private:
     std::unordered_map<uint32_t, std::shared_ptr<Properties>> m_entityProperties;
 };
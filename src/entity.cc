@@ -1,8 +1,11 @@
 #include <entity.hh>
 
 #include <point.hh>
+#include <pool.hh>
 
 #include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
 
 static const std::unordered_map<char, EntityType> charToEntity =
 {
@@ -14,10 +17,70 @@ static const std::unordered_map<char, EntityType> charToEntity =
     {'g', EntityType::GHOST},
 };
 
+// Struct-of-arrays storage for the entity state, indexed by slot. Handles (the
+// entity ids) combine the slot with a generation, so ids of destroyed entities
+// are not reused when the slot is recycled.
+class World
+{
+public:
+    static const uint32_t SLOT_BITS = 20;
+    static const uint32_t SLOT_MASK = (1U << SLOT_BITS) - 1;
+    static const uint32_t MAX_GENERATION = (1U << (32 - SLOT_BITS)) - 1;
+
+    uint32_t allocate(EntityType type, const point &where);
+
+    void release(uint32_t handle);
+
+    /// Make room for @a n more entities
+    void reserve(size_t n);
+
+    /// Flag as removed, the store destroys it later
+    void remove(uint32_t handle);
+
+    bool isRemoved(uint32_t slot) const
+    {
+        return m_removed[slot];
+    }
+
+    bool isValid(uint32_t handle) const
+    {
+        auto slot = slotOf(handle);
+
+        return slot < m_generations.size() && m_generations[slot] == generationOf(handle);
+    }
+
+    static uint32_t slotOf(uint32_t handle)
+    {
+        return handle & SLOT_MASK;
+    }
+
+    static uint32_t generationOf(uint32_t handle)
+    {
+        return handle >> SLOT_BITS;
+    }
+
+    std::vector<EntityType> m_types;
+    std::vector<point> m_positions;
+    std::vector<Direction> m_directions;
+    std::vector<uint16_t> m_generations;
+    std::vector<uint8_t> m_removed;
+
+    // Handles removed since the store last destroyed them
+    std::vector<uint32_t> m_graveyard;
+
+    // Set by the store to keep track of the occupancy, runs before the movement listeners
+    std::function<void(uint32_t handle, const point &from, const point &to)> m_onMove;
+    std::function<void(uint32_t handle)> m_onRemove;
+
+private:
+    std::vector<uint32_t> m_freeSlots;
+};
+
+// Thin facade over a World slot, lives as long as someone refers to the entity
 class Entity : public IEntity, public std::enable_shared_from_this<Entity>
 {
 public:
-    Entity(EntityType type, const point &where);
+    Entity(std::shared_ptr<World> world, uint32_t handle);
     ~Entity();
 
     EntityType getType() const override;
@@ -34,109 +97,313 @@ public:
 
     void remove() override;
 
-    std::unique_ptr<ObserverCookie> onRemoval(std::function<void(std::shared_ptr<IEntity>)> cb) override;
+    std::unique_ptr<ObserverCookie> onRemoval(std::function<void(const std::shared_ptr<IEntity> &)> cb) override;
 
-    std::unique_ptr<ObserverCookie> onMovement(std::function<void(std::shared_ptr<IEntity>,
+    std::unique_ptr<ObserverCookie> onMovement(std::function<void(const std::shared_ptr<IEntity> &,
             const point &from, const point &to)> cb) override;
 
+    // Called by the store when the entity is destroyed
+    void notifyRemoval();
+
 private:
-    const EntityType m_type;
-    point m_position;
-    uint32_t m_id;
-    Direction m_direction{Direction::NONE};
+    const std::shared_ptr<World> m_world;
+    const uint32_t m_handle;
+    const uint32_t m_slot;
 
-    Notifier1<std::shared_ptr<IEntity>> m_onRemoval;
-    Notifier3<std::shared_ptr<IEntity>, const point &, const point &> m_onMovement;
+    Notifier<std::shared_ptr<IEntity>> m_onRemoval;
+    Notifier<std::shared_ptr<IEntity>, point, point> m_onMovement;
 };
 
 class EntityStore : public IEntityStore
 {
 public:
     EntityStore();
+    ~EntityStore();
 
     std::vector<std::shared_ptr<IEntity>> getEntities() override;
 
+    void forEachEntity(const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor) override;
+
+    void forEachOfType(EntityType type, const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor) override;
+
+    void queryRect(const point &topLeft, const extents &size,
+        const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor) override;
+
+    void queryRadius(const point &center, unsigned radius,
+        const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor) override;
+
     std::shared_ptr<IEntity> getEntityByPoint(const point &where) override;
 
     std::shared_ptr<IEntity> getEntityById(uint32_t id) override;
 
-    void add(std::shared_ptr<IEntity> entity);
+    void setSize(const extents &size) override;
+
+    void getNeighborhood(const point &center, Neighborhood<1> &out) const override;
+
+    void getNeighborhood(const point &center, Neighborhood<2> &out) const override;
+
+    std::shared_ptr<IEntity> create(EntityType type, const point &where);
+
+    std::vector<std::shared_ptr<IEntity>> spawnBatch(const std::vector<EntitySpawn> &spawns) override;
+
+    void destroyRemoved() override;
+
+    std::unique_ptr<ObserverCookie> onCreation(std::function<void(const std::shared_ptr<IEntity> &entity)> cb) override;
+
+    std::unique_ptr<ObserverCookie> onBatchCreation(std::function<void(const std::vector<std::shared_ptr<IEntity>> &entities)> cb) override;
+
+    std::unique_ptr<ObserverCookie> onCollision(std::function<void(const std::shared_ptr<IEntity> &one, const std::shared_ptr<IEntity> &other)> cb) override;
+
+    std::unique_ptr<ObserverCookie> onDestruction(std::function<void(const std::vector<uint32_t> &ids)> cb) override;
+
+    std::unique_ptr<ObserverCookie> onOccupancyChange(std::function<void(const point &where)> cb) override;
+
+    void setEventQueueing(bool queue) override;
 
-    std::unique_ptr<ObserverCookie> onCreation(std::function<void(std::shared_ptr<IEntity> entity)> cb) override;
+    void dispatchEvents() override;
 
-    std::unique_ptr<ObserverCookie> onCollision(std::function<void(std::shared_ptr<IEntity> one, std::shared_ptr<IEntity> other)> cb) override;
+    std::unique_ptr<ObserverCookie> onMovements(std::function<void(const std::vector<MovementEvent> &events)> cb) override;
+
+    std::unique_ptr<ObserverCookie> onCollisions(std::function<void(const std::vector<CollisionEvent> &events)> cb) override;
 
 private:
-    std::unordered_map<uint32_t, std::shared_ptr<IEntity>> m_entities;
-    std::unordered_map<point, std::shared_ptr<IEntity>> m_entitiesByPoint;
+    struct Slot
+    {
+        std::shared_ptr<IEntity> entity;
+        uint32_t typeIndex{0}; // Index in m_slotsByType
+    };
 
-    std::unordered_map<uint32_t, std::unique_ptr<ObserverCookie>> m_movementCookies;
-    std::unordered_map<uint32_t, std::unique_ptr<ObserverCookie>> m_removalCookies;
+    // In the store and not removed
+    bool isLive(uint32_t slot) const
+    {
+        return m_slots[slot].entity && !m_world->isRemoved(slot);
+    }
 
-    Notifier2<std::shared_ptr<IEntity>, std::shared_ptr<IEntity>> m_onCollision;
-    Notifier1<std::shared_ptr<IEntity>> m_onCreation;
+    std::shared_ptr<IEntity> attach(EntityType type, const point &where);
+    bool settle(const std::shared_ptr<IEntity> &entity);
+    void handleMovement(uint32_t id, const point &from, const point &to);
+    void handleRemoval(uint32_t id);
+    void collide(uint32_t one, uint32_t other);
+    void dispatchCollisions();
+    void addToType(uint32_t slot, EntityType type);
+    void removeFromType(uint32_t slot, EntityType type);
+
+    bool inGrid(const point &where) const;
+    uint32_t idAt(const point &where) const;
+    template<int R>
+    void fillNeighborhood(const point &center, Neighborhood<R> &out) const;
+    void place(const point &where, uint32_t id);
+    void clear(const point &where, uint32_t id);
+    uint8_t &chunkCount(int x, int y);
+
+    std::shared_ptr<World> m_world;
+
+    // Entities in the store, indexed by World slot
+    std::vector<Slot> m_slots;
+
+    // Dense lists of the slots in the store, per entity type
+    std::vector<uint32_t> m_slotsByType[ENTITY_TYPE_COUNT];
+
+    // Dense occupancy grid with the entity id at each point (0 for empty), as
+    // large as the level
+    std::vector<uint32_t> m_grid;
+    extents m_gridSize;
+
+    // The number of occupied grid cells in each CHUNK_SIZE x CHUNK_SIZE chunk,
+    // so area queries can skip empty parts of the level
+    static const unsigned CHUNK_SIZE = 8;
+    std::vector<uint8_t> m_chunkCounts;
+    extents m_chunkGridSize;
+
+    Notifier<std::shared_ptr<IEntity>, std::shared_ptr<IEntity>> m_onCollision;
+    Notifier<std::shared_ptr<IEntity>> m_onCreation;
+    Notifier<std::vector<std::shared_ptr<IEntity>>> m_onBatchCreation;
+    Notifier<std::vector<uint32_t>> m_onDestruction;
+    Notifier<point> m_onOccupancyChange;
+
+    // The event queue, the vectors are reused between ticks
+    bool m_queueing{false};
+    std::vector<MovementEvent> m_movements;
+    std::vector<CollisionEvent> m_collisions;
+
+    Notifier<std::vector<MovementEvent>> m_onMovements;
+    Notifier<std::vector<CollisionEvent>> m_onCollisions;
 };
 
+// Hand the queued events to @a dispatch, and then keep the capacity unless
+// more events were queued meanwhile
+template<typename T, typename Fn>
+static void drain(std::vector<T> &queue, Fn dispatch)
+{
+    std::vector<T> batch;
+
+    std::swap(batch, queue);
+    dispatch(batch);
+
+    if (queue.empty())
+    {
+        batch.clear();
+        std::swap(batch, queue);
+    }
+}
+
+// Like reserve(), but growing geometrically so that many small batches don't
+// reallocate each time
+template<typename T>
+static void reserveAtLeast(std::vector<T> &v, size_t size)
+{
+    if (size > v.capacity())
+    {
+        v.reserve(std::max(size, v.capacity() * 2));
+    }
+}
+
+
+
+uint32_t World::allocate(EntityType type, const point &where)
+{
+    uint32_t slot;
+
+    if (!m_freeSlots.empty())
+    {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+
+        m_types[slot] = type;
+        m_positions[slot] = where;
+        m_directions[slot] = Direction::NONE;
+        m_removed[slot] = false;
+    }
+    else
+    {
+        slot = (uint32_t)m_generations.size();
+        if (slot > SLOT_MASK)
+        {
+            throw std::out_of_range("Too many entities");
+        }
+
+        m_types.push_back(type);
+        m_positions.push_back(where);
+        m_directions.push_back(Direction::NONE);
+        m_removed.push_back(false);
+        m_generations.push_back(1); // Never 0, so no handle is 0
+    }
+
+    return (m_generations[slot] << SLOT_BITS) | slot;
+}
+
+void World::reserve(size_t n)
+{
+    if (n <= m_freeSlots.size())
+    {
+        return;
+    }
+
+    auto size = m_generations.size() + n - m_freeSlots.size();
+
+    reserveAtLeast(m_types, size);
+    reserveAtLeast(m_positions, size);
+    reserveAtLeast(m_directions, size);
+    reserveAtLeast(m_generations, size);
+    reserveAtLeast(m_removed, size);
+}
+
+void World::remove(uint32_t handle)
+{
+    auto slot = slotOf(handle);
+
+    if (m_removed[slot])
+    {
+        return;
+    }
+
+    m_removed[slot] = true;
+    m_graveyard.push_back(handle);
 
+    if (m_onRemove)
+    {
+        m_onRemove(handle);
+    }
+}
 
-Entity::Entity(EntityType type, const point &where) :
-    m_type(type),
-    m_position(where)
+void World::release(uint32_t handle)
 {
-    static uint32_t g_entityId = 1;
+    auto slot = slotOf(handle);
 
-    m_id = g_entityId++;
+    m_generations[slot] = m_generations[slot] == MAX_GENERATION ? 1 : m_generations[slot] + 1;
+    m_freeSlots.push_back(slot);
+}
+
+
+Entity::Entity(std::shared_ptr<World> world, uint32_t handle) :
+    m_world(world),
+    m_handle(handle),
+    m_slot(World::slotOf(handle))
+{
 }
 
 Entity::~Entity()
 {
+    m_world->release(m_handle);
 }
 
 EntityType Entity::getType() const
 {
-    return m_type;
+    return m_world->m_types[m_slot];
 }
 
 point Entity::getPosition() const
 {
-    return m_position;
+    return m_world->m_positions[m_slot];
 }
 
 uint32_t Entity::getId() const
 {
-    return m_id;
+    return m_handle;
 }
 
 void Entity::setPosition(const point &dst)
 {
-    m_onMovement.invoke(shared_from_this(), m_position, dst);
-    m_position = dst;
+    // A copy, since the listeners might create entities
+    auto from = m_world->m_positions[m_slot];
+
+    if (m_world->m_onMove)
+    {
+        m_world->m_onMove(m_handle, from, dst);
+    }
+    m_onMovement.invoke(shared_from_this(), from, dst);
+    m_world->m_positions[m_slot] = dst;
 }
 
 Direction Entity::getDirection() const
 {
-    return m_direction;
+    return m_world->m_directions[m_slot];
 }
 
 void Entity::setDirection(Direction dir)
 {
-    m_direction = dir;
+    m_world->m_directions[m_slot] = dir;
 }
 
 void Entity::remove()
+{
+    m_world->remove(m_handle);
+}
+
+void Entity::notifyRemoval()
 {
     m_onRemoval.invoke(shared_from_this());
 }
 
-std::unique_ptr<ObserverCookie> Entity::onRemoval(std::function<void(std::shared_ptr<IEntity>)> cb)
+std::unique_ptr<ObserverCookie> Entity::onRemoval(std::function<void(const std::shared_ptr<IEntity> &)> cb)
 {
-    return m_onRemoval.listen(cb);
+    return m_onRemoval.listen(std::move(cb));
 }
 
-std::unique_ptr<ObserverCookie> Entity::onMovement(std::function<void(std::shared_ptr<IEntity>,
+std::unique_ptr<ObserverCookie> Entity::onMovement(std::function<void(const std::shared_ptr<IEntity> &,
         const point &from, const point &to)> cb)
 {
-    return m_onMovement.listen(cb);
+    return m_onMovement.listen(std::move(cb));
 }
 
 
@@ -151,114 +418,565 @@ bool IEntity::isValid(char c)
     return true;
 }
 
-std::shared_ptr<IEntity> IEntity::createFromChar(char c, const point &where)
+std::optional<EntityType> IEntity::typeFromChar(char c)
 {
     auto it = charToEntity.find(c);
 
     if (it == charToEntity.end())
     {
-        return nullptr;
+        return std::optional<EntityType>();
     }
 
-    return createFromType(it->second, where);
+    return it->second;
 }
 
-std::shared_ptr<IEntity> IEntity::createFromType(EntityType type, const point &where)
+std::shared_ptr<IEntity> IEntity::createFromChar(char c, const point &where)
 {
-    std::shared_ptr<IEntity> out;
+    auto type = typeFromChar(c);
+
+    if (!type)
+    {
+        return nullptr;
+    }
 
-    out = std::shared_ptr<IEntity>(new Entity(type, where));
+    return createFromType(*type, where);
+}
 
+std::shared_ptr<IEntity> IEntity::createFromType(EntityType type, const point &where)
+{
     auto store = std::dynamic_pointer_cast<EntityStore>(IEntityStore::getInstance());
 
-    store->add(out);
+    return store->create(type, where);
+}
 
-    return out;
+EntityStore::EntityStore() :
+    m_world(std::make_shared<World>())
+{
+    m_world->m_onMove = [this](uint32_t handle, const point &from, const point &to)
+    {
+        handleMovement(handle, from, to);
+    };
+    m_world->m_onRemove = [this](uint32_t handle)
+    {
+        handleRemoval(handle);
+    };
 }
 
-EntityStore::EntityStore()
+EntityStore::~EntityStore()
 {
+    // Entities might outlive the store
+    m_world->m_onMove = nullptr;
+    m_world->m_onRemove = nullptr;
 }
 
 std::vector<std::shared_ptr<IEntity>> EntityStore::getEntities()
 {
     std::vector<std::shared_ptr<IEntity>> out;
 
-    for (auto &it : m_entities)
+    for (uint32_t slot = 0; slot < m_slots.size(); slot++)
     {
-        out.push_back(it.second);
+        if (isLive(slot))
+        {
+            out.push_back(m_slots[slot].entity);
+        }
     }
 
     return out;
 }
 
+void EntityStore::forEachEntity(const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor)
+{
+    // In slot order, to walk the World arrays sequentially
+    for (uint32_t slot = 0; slot < m_slots.size(); slot++)
+    {
+        if (isLive(slot))
+        {
+            visitor(m_slots[slot].entity);
+        }
+    }
+}
+
+void EntityStore::forEachOfType(EntityType type, const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor)
+{
+    for (auto slot : m_slotsByType[(unsigned)type])
+    {
+        if (!m_world->isRemoved(slot))
+        {
+            visitor(m_slots[slot].entity);
+        }
+    }
+}
+
 std::shared_ptr<IEntity> EntityStore::getEntityByPoint(const point &where)
 {
-    auto it = m_entitiesByPoint.find(where);
+    auto id = idAt(where);
 
-    if (it == m_entitiesByPoint.end())
+    if (id == 0 || m_world->isRemoved(World::slotOf(id)))
     {
         return nullptr;
     }
 
-    return it->second;
+    return m_slots[World::slotOf(id)].entity;
+}
+
+template<int R>
+void EntityStore::fillNeighborhood(const point &center, Neighborhood<R> &out) const
+{
+    for (int dy = -R; dy <= R; dy++)
+    {
+        for (int dx = -R; dx <= R; dx++)
+        {
+            auto &cell = out.at(dx, dy);
+            auto id = idAt({center.x + dx, center.y + dy});
+
+            if (id == 0 || m_world->isRemoved(World::slotOf(id)))
+            {
+                cell.entity = Neighborhood<R>::NONE;
+                cell.id = 0;
+            }
+            else
+            {
+                cell.entity = (uint8_t)m_world->m_types[World::slotOf(id)];
+                cell.id = id;
+            }
+        }
+    }
+}
+
+void EntityStore::getNeighborhood(const point &center, Neighborhood<1> &out) const
+{
+    fillNeighborhood(center, out);
+}
+
+void EntityStore::getNeighborhood(const point &center, Neighborhood<2> &out) const
+{
+    fillNeighborhood(center, out);
 }
 
 std::shared_ptr<IEntity> EntityStore::getEntityById(uint32_t id)
 {
-    auto it = m_entities.find(id);
+    auto slot = World::slotOf(id);
 
-    if (it == m_entities.end())
+    // Valid, but perhaps removed from the store
+    if (!m_world->isValid(id) || slot >= m_slots.size() || !isLive(slot))
     {
         return nullptr;
     }
 
-    return it->second;
+    return m_slots[slot].entity;
 }
 
-void EntityStore::add(std::shared_ptr<IEntity> entity)
+std::shared_ptr<IEntity> EntityStore::create(EntityType type, const point &where)
 {
-    m_removalCookies[entity->getId()] = entity->onRemoval([this](std::shared_ptr<IEntity> entity)
+    auto out = attach(type, where);
+
+    if (settle(out))
+    {
+        m_onCreation.invoke(out);
+    }
+
+    return out;
+}
+
+std::vector<std::shared_ptr<IEntity>> EntityStore::spawnBatch(const std::vector<EntitySpawn> &spawns)
+{
+    std::vector<std::shared_ptr<IEntity>> out;
+
+    out.reserve(spawns.size());
+    m_world->reserve(spawns.size());
+    reserveAtLeast(m_slots, m_slots.size() + spawns.size());
+
+    for (auto &cur : spawns)
+    {
+        out.push_back(attach(cur.type, cur.where));
+    }
+
+    // Collisions and placement in one pass, dropping entities destroyed on the way
+    out.erase(std::remove_if(out.begin(), out.end(), [this](const std::shared_ptr<IEntity> &ent)
+    {
+        return !settle(ent);
+    }), out.end());
+
+    if (!out.empty())
     {
-        m_removalCookies.erase(entity->getId());
-        m_entities.erase(entity->getId());
-        m_entitiesByPoint.erase(entity->getPosition());
+        m_onBatchCreation.invoke(out);
+    }
+
+    return out;
+}
+
+std::shared_ptr<IEntity> EntityStore::attach(EntityType type, const point &where)
+{
+    auto handle = m_world->allocate(type, where);
+    auto entity = std::allocate_shared<Entity>(PoolAllocator<Entity>(), m_world, handle);
+    auto slotIndex = World::slotOf(handle);
+
+    if (slotIndex >= m_slots.size())
+    {
+        m_slots.resize(slotIndex + 1);
+    }
+    auto &slot = m_slots[slotIndex];
+
+    slot.entity = entity;
+    addToType(slotIndex, type);
+
+    return entity;
+}
+
+bool EntityStore::settle(const std::shared_ptr<IEntity> &entity)
+{
+    auto where = entity->getPosition();
+
+    // Another already here?
+    auto other = getEntityByPoint(where);
+    if (other)
+    {
+        collide(entity->getId(), other->getId());
+    }
+
+    // The collision might have removed it
+    if (m_world->isRemoved(World::slotOf(entity->getId())))
+    {
+        return false;
+    }
+
+    place(where, entity->getId());
+    m_onOccupancyChange.invoke(where);
+
+    return true;
+}
+
+void EntityStore::destroyRemoved()
+{
+    // Listeners might remove more entities, so loop until done
+    while (!m_world->m_graveyard.empty())
+    {
+        std::vector<uint32_t> ids;
+        std::vector<std::shared_ptr<IEntity>> destroyed;
+
+        std::swap(ids, m_world->m_graveyard);
+        destroyed.reserve(ids.size());
+
+        for (auto id : ids)
+        {
+            auto slotIndex = World::slotOf(id);
+
+            if (slotIndex >= m_slots.size() || !m_slots[slotIndex].entity)
+            {
+                // Not in this store
+                continue;
+            }
+
+            auto &slot = m_slots[slotIndex];
+
+            removeFromType(slotIndex, slot.entity->getType());
+            clear(slot.entity->getPosition(), id);
+
+            // Keep it alive until everyone has been told
+            destroyed.push_back(std::move(slot.entity));
+        }
+
+        for (auto &ent : destroyed)
+        {
+            static_cast<Entity *>(ent.get())->notifyRemoval();
+        }
+        m_onDestruction.invoke(ids);
+    }
+}
+
+void EntityStore::handleMovement(uint32_t id, const point &from, const point &to)
+{
+    auto slotIndex = World::slotOf(id);
+
+    if (slotIndex >= m_slots.size() || !m_slots[slotIndex].entity)
+    {
+        // Not in this store (anymore)
+        return;
+    }
+
+    if (m_queueing)
+    {
+        m_movements.push_back({id, from, to});
+    }
+
+    if (m_world->isRemoved(slotIndex))
+    {
+        // Removed entities don't occupy anything
+        clear(from, id);
+        return;
+    }
+
+    auto other = getEntityByPoint(to);
+
+    if (other)
+    {
+        collide(id, other->getId());
+    }
+    clear(from, id);
+    place(to, id);
+
+    m_onOccupancyChange.invoke(from);
+    m_onOccupancyChange.invoke(to);
+}
+
+void EntityStore::handleRemoval(uint32_t id)
+{
+    auto slotIndex = World::slotOf(id);
+
+    if (slotIndex < m_slots.size() && m_slots[slotIndex].entity)
+    {
+        // Gone from the lookups at once
+        m_onOccupancyChange.invoke(m_world->m_positions[slotIndex]);
+    }
+}
+
+void EntityStore::collide(uint32_t one, uint32_t other)
+{
+    m_collisions.push_back({one, other});
+
+    if (!m_queueing)
+    {
+        dispatchCollisions();
+    }
+}
+
+void EntityStore::dispatchCollisions()
+{
+    if (m_collisions.empty())
+    {
+        return;
+    }
+
+    drain(m_collisions, [this](const std::vector<CollisionEvent> &batch)
+    {
+        for (auto &ev : batch)
+        {
+            auto one = getEntityById(ev.one);
+            auto other = getEntityById(ev.other);
+
+            // Earlier collisions might have removed them
+            if (one && other)
+            {
+                m_onCollision.invoke(one, other);
+            }
+        }
+        m_onCollisions.invoke(batch);
     });
+}
 
-    // Check for collisions on movement
-    m_movementCookies[entity->getId()] = entity->onMovement([this](std::shared_ptr<IEntity> ent, const point &from, const point &to)
+void EntityStore::setEventQueueing(bool queue)
+{
+    if (!queue)
     {
-        auto other = getEntityByPoint(to);
+        dispatchEvents();
+    }
+    m_queueing = queue;
+}
 
-        if (other)
+void EntityStore::dispatchEvents()
+{
+    // Listeners might move things around, so loop until done
+    while (!m_movements.empty() || !m_collisions.empty())
+    {
+        if (!m_movements.empty())
         {
-            m_onCollision.invoke(ent, other);
+            drain(m_movements, [this](const std::vector<MovementEvent> &batch)
+            {
+                m_onMovements.invoke(batch);
+            });
+        }
+
+        dispatchCollisions();
+    }
+}
+
+void EntityStore::addToType(uint32_t slot, EntityType type)
+{
+    auto &slots = m_slotsByType[(unsigned)type];
+
+    m_slots[slot].typeIndex = (uint32_t)slots.size();
+    slots.push_back(slot);
+}
+
+void EntityStore::removeFromType(uint32_t slot, EntityType type)
+{
+    auto &slots = m_slotsByType[(unsigned)type];
+    auto idx = m_slots[slot].typeIndex;
+
+    // Swap with the last one to keep the list dense
+    slots[idx] = slots.back();
+    m_slots[slots[idx]].typeIndex = idx;
+    slots.pop_back();
+}
+
+void EntityStore::queryRect(const point &topLeft, const extents &size,
+    const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor)
+{
+    // Clip to the grid
+    int x0 = std::max(topLeft.x, 0);
+    int y0 = std::max(topLeft.y, 0);
+    int x1 = std::min(topLeft.x + (int)size.width, (int)m_gridSize.width);
+    int y1 = std::min(topLeft.y + (int)size.height, (int)m_gridSize.height);
+
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    for (int chunkY = y0 / (int)CHUNK_SIZE; chunkY <= (y1 - 1) / (int)CHUNK_SIZE; chunkY++)
+    {
+        for (int chunkX = x0 / (int)CHUNK_SIZE; chunkX <= (x1 - 1) / (int)CHUNK_SIZE; chunkX++)
+        {
+            if (m_chunkCounts[chunkY * m_chunkGridSize.width + chunkX] == 0)
+            {
+                continue;
+            }
+
+            int cellX1 = std::min((chunkX + 1) * (int)CHUNK_SIZE, x1);
+            int cellY1 = std::min((chunkY + 1) * (int)CHUNK_SIZE, y1);
+
+            for (int y = std::max(chunkY * (int)CHUNK_SIZE, y0); y < cellY1; y++)
+            {
+                for (int x = std::max(chunkX * (int)CHUNK_SIZE, x0); x < cellX1; x++)
+                {
+                    auto id = m_grid[y * m_gridSize.width + x];
+
+                    if (id && !m_world->isRemoved(World::slotOf(id)))
+                    {
+                        visitor(m_slots[World::slotOf(id)].entity);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void EntityStore::queryRadius(const point &center, unsigned radius,
+    const std::function<void(const std::shared_ptr<IEntity> &entity)> &visitor)
+{
+    const int r = radius;
+    const point topLeft = {center.x - r, center.y - r};
+
+    queryRect(topLeft, {radius * 2 + 1, radius * 2 + 1}, [&center, r, &visitor](const std::shared_ptr<IEntity> &entity)
+    {
+        auto d = entity->getPosition() - center;
+
+        if (d.x * d.x + d.y * d.y <= r * r)
+        {
+            visitor(entity);
         }
-        m_entitiesByPoint.erase(from);
-        m_entitiesByPoint[to] = ent;
     });
+}
 
-    // Another already here?
-    auto other = getEntityByPoint(entity->getPosition());
-    if (other)
+bool EntityStore::inGrid(const point &where) const
+{
+    return where.x >= 0 && where.y >= 0 && where.x < (int)m_gridSize.width && where.y < (int)m_gridSize.height;
+}
+
+uint32_t EntityStore::idAt(const point &where) const
+{
+    if (!inGrid(where))
+    {
+        return 0;
+    }
+
+    return m_grid[where.y * m_gridSize.width + where.x];
+}
+
+void EntityStore::place(const point &where, uint32_t id)
+{
+    if (!inGrid(where))
+    {
+        throw std::out_of_range("Entity outside the level");
+    }
+
+    auto &cell = m_grid[where.y * m_gridSize.width + where.x];
+    if (cell == 0)
     {
-        m_onCollision.invoke(entity, other);
+        chunkCount(where.x, where.y)++;
     }
+    cell = id;
+}
+
+void EntityStore::clear(const point &where, uint32_t id)
+{
+    // Only clear if the point is still ours, another entity might have moved in
+    if (idAt(where) == id)
+    {
+        m_grid[where.y * m_gridSize.width + where.x] = 0;
+        chunkCount(where.x, where.y)--;
+    }
+}
+
+uint8_t &EntityStore::chunkCount(int x, int y)
+{
+    return m_chunkCounts[(y / CHUNK_SIZE) * m_chunkGridSize.width + x / CHUNK_SIZE];
+}
+
+void EntityStore::setSize(const extents &size)
+{
+    m_gridSize = size;
+    m_grid.assign(size.width * size.height, 0);
+
+    m_chunkGridSize = {(size.width + CHUNK_SIZE - 1) / CHUNK_SIZE, (size.height + CHUNK_SIZE - 1) / CHUNK_SIZE};
+    m_chunkCounts.assign(m_chunkGridSize.width * m_chunkGridSize.height, 0);
+
+    // Entities already in the store must fit as well. Those left over from a
+    // larger level can't be in this one, so they are removed
+    for (uint32_t slot = 0; slot < m_slots.size(); slot++)
+    {
+        if (!isLive(slot))
+        {
+            continue;
+        }
+
+        auto &entity = m_slots[slot].entity;
 
-    m_entities[entity->getId()] = entity;
-    m_entitiesByPoint[entity->getPosition()] = entity;
-    m_onCreation.invoke(entity);
+        if (inGrid(m_world->m_positions[slot]))
+        {
+            place(m_world->m_positions[slot], entity->getId());
+        }
+        else
+        {
+            entity->remove();
+        }
+    }
+}
+
+std::unique_ptr<ObserverCookie> EntityStore::onCreation(std::function<void(const std::shared_ptr<IEntity> &entity)> cb)
+{
+    return m_onCreation.listen(std::move(cb));
+}
+
+std::unique_ptr<ObserverCookie> EntityStore::onBatchCreation(std::function<void(const std::vector<std::shared_ptr<IEntity>> &entities)> cb)
+{
+    return m_onBatchCreation.listen(std::move(cb));
+}
+
+std::unique_ptr<ObserverCookie> EntityStore::onDestruction(std::function<void(const std::vector<uint32_t> &ids)> cb)
+{
+    return m_onDestruction.listen(std::move(cb));
+}
+
+std::unique_ptr<ObserverCookie> EntityStore::onCollision(std::function<void(const std::shared_ptr<IEntity> &one,
+        const std::shared_ptr<IEntity> &other)> cb)
+{
+    return m_onCollision.listen(std::move(cb));
+}
+
+std::unique_ptr<ObserverCookie> EntityStore::onOccupancyChange(std::function<void(const point &where)> cb)
+{
+    return m_onOccupancyChange.listen(std::move(cb));
 }
 
-std::unique_ptr<ObserverCookie> EntityStore::onCreation(std::function<void(std::shared_ptr<IEntity> entity)> cb)
+std::unique_ptr<ObserverCookie> EntityStore::onMovements(std::function<void(const std::vector<MovementEvent> &events)> cb)
 {
-    return m_onCreation.listen(cb);
+    return m_onMovements.listen(std::move(cb));
 }
 
-std::unique_ptr<ObserverCookie> EntityStore::onCollision(std::function<void(std::shared_ptr<IEntity> one,
-        std::shared_ptr<IEntity> other)> cb)
+std::unique_ptr<ObserverCookie> EntityStore::onCollisions(std::function<void(const std::vector<CollisionEvent> &events)> cb)
 {
-    return m_onCollision.listen(cb);
+    return m_onCollisions.listen(std::move(cb));
 }
 
 std::shared_ptr<IEntityStore> IEntityStore::getInstance()
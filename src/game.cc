@@ -11,17 +11,23 @@
 
 #include <memory>
 
+// Game time per tick, and the number of frames displayed during a tick
+static const unsigned TICK_MS = 160;
+static const unsigned FRAMES_PER_TICK = 8;
+
 class Game : public IGame
 {
 public:
-    Game()
+    Game(bool headless, unsigned maxTicks) :
+        m_headless(headless),
+        m_maxTicks(maxTicks)
     {
     }
 
     bool setLevel(const std::string &levelData) override
     {
         m_currentLevel.reset();
-        auto cur = std::make_unique<CurrentLevel>();
+        auto cur = std::make_unique<CurrentLevel>(m_threads);
 
         if (!cur->setLevel(levelData))
         {
@@ -34,7 +40,8 @@ public:
 
     bool play() override
     {
-        auto io = IIo::getInstance();
+        // Headless games never touch the display, and use game time instead of wall time
+        auto io = m_headless ? nullptr : IIo::getInstance();
 
         if (!m_currentLevel)
         {
@@ -47,50 +54,74 @@ public:
 
         // Check for player aliveness
         unsigned timeSinceDead = 0;
-        auto cookie = player->onRemoval([&timeSinceDead, &playerAlive, io](std::shared_ptr<IEntity> entity)
+        auto cookie = player->onRemoval([this, &timeSinceDead, &playerAlive, io](const std::shared_ptr<IEntity> &entity)
         {
             playerAlive = false;
-            timeSinceDead = io->msSince(0);
+            timeSinceDead = msSince(io, 0);
         });
 
         auto lightning = m_currentLevel->getLightning();
         auto level = m_currentLevel->getLevel();
         auto levelAnimator = m_currentLevel->getLevelAnimator();
 
-        while (1)
+        while (m_maxTicks == 0 || m_ticks < m_maxTicks)
         {
-            if (!playerAlive && io->msSince(timeSinceDead) > 2500)
+            if (!playerAlive && msSince(io, timeSinceDead) > 2500)
             {
                 //  Didn't pass this level
                 return false;
             }
 
-            m_currentLevel->run(160);
+            m_currentLevel->run(TICK_MS);
             auto lighted = level->getIllumination(player->getPosition(), player->getDirection());
             lightning->updateLightning(lighted);
 
-            for (unsigned i = 0; i < 8; i++)
+            m_ticks++;
+            m_onTick.invoke(m_ticks);
+
+            if (m_headless)
+            {
+                continue;
+            }
+
+            for (unsigned i = 0; i < FRAMES_PER_TICK; i++)
             {
                 animate(i);
                 io->display(player, m_currentLevel->getLevel(), lightning, levelAnimator, m_currentLevel->getAnimators());
-                io->delay(160/8);
+                io->delay(TICK_MS / FRAMES_PER_TICK);
             }
         }
 
-        return true;
+        return playerAlive;
+    }
+
+    void setThreads(unsigned threads) override
+    {
+        m_threads = threads;
+    }
+
+    std::unique_ptr<ObserverCookie> onTick(std::function<void(unsigned tick)> cb) override
+    {
+        return m_onTick.listen(std::move(cb));
     }
 
 private:
     class CurrentLevel
     {
     public:
-        CurrentLevel() :
+        CurrentLevel(unsigned threads) :
+            m_threads(threads),
             m_entityStore(IEntityStore::getInstance()),
             m_entityProperties(IEntityProperties::getInstance()),
             m_resourceStore(IResourceStore::getInstance())
         {
         }
 
+        ~CurrentLevel()
+        {
+            m_entityStore->setEventQueueing(false);
+        }
+
         bool setLevel(const std::string &str)
         {
             m_level = ILevel::fromString(str);
@@ -103,6 +134,7 @@ private:
             auto entities = m_entityStore->getEntities();
 
             // Create behavior
+            m_behaviors = IEntityBehaviors::create(m_level, m_threads);
             m_levelBehavior = IBehavior::fromLevel(m_level);
             for (auto &it : entities)
             {
@@ -115,10 +147,41 @@ private:
             }
 
             // And listen for new creations
-            m_cookie = m_entityStore->onCreation([this](std::shared_ptr<IEntity> entity)
+            m_cookie = m_entityStore->onCreation([this](const std::shared_ptr<IEntity> &entity)
             {
                 addEntity(entity);
             });
+            m_batchCookie = m_entityStore->onBatchCreation([this](const std::vector<std::shared_ptr<IEntity>> &entities)
+            {
+                for (auto &it : entities)
+                {
+                    addEntity(it);
+                }
+            });
+            m_destructionCookie = m_entityStore->onDestruction([this](const std::vector<uint32_t> &ids)
+            {
+                for (auto id : ids)
+                {
+                    m_behaviors->removeEntity(id);
+                    m_animators.erase(id);
+                    m_entityProperties->removeEntity(id);
+                }
+            });
+
+            // Movements and collisions are handled in bulk after the behaviors
+            m_entityStore->setEventQueueing(true);
+            m_movementsCookie = m_entityStore->onMovements([this](const std::vector<MovementEvent> &events)
+            {
+                for (auto &ev : events)
+                {
+                    auto it = m_animators.find(ev.id);
+
+                    if (it != m_animators.end())
+                    {
+                        it->second->move(ev.from, ev.to);
+                    }
+                }
+            });
 
             m_lightning = ILightning::create(m_level);
             m_levelAnimator = ILevelAnimator::fromLightning(m_lightning);
@@ -130,17 +193,13 @@ private:
 
         void run(unsigned ms)
         {
-            for (auto &it : m_behavior)
-            {
-                it.second->run(ms);
-            }
+            m_behaviors->run(ms);
             m_levelBehavior->run(ms);
 
-            // Remove all now invalid behaviors
-            for (auto &it : m_toErase)
-            {
-                m_behavior.erase(it);
-            }
+            m_entityStore->dispatchEvents();
+
+            // Destroy everything removed during the tick
+            m_entityStore->destroyRemoved();
         }
 
         std::shared_ptr<IEntity> getPlayer() const
@@ -178,23 +237,11 @@ private:
         {
             auto id = entity->getId();
 
-            m_behavior[id] = IBehavior::fromEntity(m_level, entity);
+            m_behaviors->addEntity(entity);
             m_animators[id] = IAnimator::fromEntity(entity, m_resourceStore->getFrameExtents(), 8);
-
-            m_removalCookies[id] = entity->onRemoval([this](std::shared_ptr<IEntity> toRemove)
-            {
-                auto id = toRemove->getId();
-
-                auto it = m_behavior.find(id);
-                if (it != m_behavior.end())
-                {
-                    m_toErase.push_back(it->first);
-                }
-                m_removalCookies.erase(id);
-                m_animators.erase(id);
-            });
         }
 
+        unsigned m_threads;
         std::shared_ptr<ILevel> m_level;
         std::shared_ptr<ILightning> m_lightning;
         std::shared_ptr<ILevelAnimator> m_levelAnimator;
@@ -203,15 +250,15 @@ private:
         std::shared_ptr<IResourceStore> m_resourceStore;
         std::shared_ptr<IEntity> m_player;
 
-        std::unordered_map<uint32_t, std::unique_ptr<IBehavior>> m_behavior;
-        std::unordered_map<uint32_t, std::unique_ptr<ObserverCookie>> m_removalCookies;
+        std::unique_ptr<IEntityBehaviors> m_behaviors;
 
         std::unordered_map<uint32_t, std::shared_ptr<IAnimator>> m_animators;
 
-        std::vector<uint32_t> m_toErase;
-
         std::unique_ptr<IBehavior> m_levelBehavior;
         std::unique_ptr<ObserverCookie> m_cookie;
+        std::unique_ptr<ObserverCookie> m_batchCookie;
+        std::unique_ptr<ObserverCookie> m_destructionCookie;
+        std::unique_ptr<ObserverCookie> m_movementsCookie;
     };
 
     void animate(unsigned round)
@@ -223,6 +270,22 @@ private:
         m_currentLevel->getLevelAnimator()->animate(round);
     }
 
+    uint32_t msSince(std::shared_ptr<IIo> io, uint32_t last) const
+    {
+        if (m_headless)
+        {
+            return m_ticks * TICK_MS - last;
+        }
+
+        return io->msSince(last);
+    }
+
+    const bool m_headless;
+    const unsigned m_maxTicks;
+    unsigned m_ticks{0};
+    unsigned m_threads{1};
+
+    Notifier<unsigned> m_onTick;
     std::unique_ptr<CurrentLevel> m_currentLevel;
 };
 
@@ -230,7 +293,14 @@ private:
 
 std::shared_ptr<IGame> IGame::create()
 {
-    auto out = std::make_shared<Game>();
+    auto out = std::make_shared<Game>(false, 0);
+
+    return out;
+}
+
+std::shared_ptr<IGame> IGame::createHeadless(unsigned maxTicks)
+{
+    auto out = std::make_shared<Game>(true, maxTicks);
 
     return out;
 }
@@ -12,6 +12,8 @@
 
 #include <SDL.h>
 
+#include <algorithm>
+
 class SDL2Io : public IInput, public IIo
 {
 public:
@@ -86,13 +88,20 @@ public:
             center.y = levelSize.height * frameSize.width - windowHeight;
         }
 
-        auto lighted = lightning->getLighted();
+        // Only draw the tiles within the window
+        int firstX = std::max(center.x / (int)frameSize.width, 0);
+        int firstY = std::max(center.y / (int)frameSize.height, 0);
+        int lastX = std::min((center.x + windowWidth) / (int)frameSize.width + 1, (int)levelSize.width);
+        int lastY = std::min((center.y + windowHeight) / (int)frameSize.height + 1, (int)levelSize.height);
 
         auto gray = getTextureFromImageEntry({Image::GRAY, 0});
+        SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 255);
         SDL_RenderClear(m_renderer);
-        for (int y = 0; y < levelSize.height; y++)
+        for (int y = firstY; y < lastY; y++)
         {
-            for (int x = 0; x < levelSize.width; x++)
+            auto lit = lightning->getLit().row(y);
+
+            for (int x = firstX; x < lastX; x++)
             {
                 auto cur = (point){x,y};
                 auto tile = lightning->tileAt(cur);
@@ -116,27 +125,49 @@ public:
                 SDL_Rect dst = {scaled.x, scaled.y, (int)frameSize.width, (int)frameSize.height};
 
                 SDL_RenderCopy(m_renderer, texture, nullptr, &dst);
-                if (lighted.find(cur) == lighted.end())
+                if (!((lit[x / 64] >> (x % 64)) & 1))
                 {
-                    SDL_RenderCopy(m_renderer, gray, nullptr, &dst);
+                    auto light = lightning->getLightLevel(cur);
+
+                    if (light == 0)
+                    {
+                        SDL_RenderCopy(m_renderer, gray, nullptr, &dst);
+                    }
+                    else
+                    {
+                        // Darker further away from fireballs and bombs
+                        SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, (ILightning::LIGHT_FULL + 1 - light) * 40);
+                        SDL_RenderFillRect(m_renderer, &dst);
+                    }
                 }
             }
         }
 
-        for (auto &id : lightning->getVisibleEntities())
+        // The entities in the light within the window. With a tile to spare,
+        // for those which are still moving in from outside it
+        const point topLeft = {firstX - 1, firstY - 1};
+        const extents size = {(unsigned)(lastX - firstX + 2), (unsigned)(lastY - firstY + 2)};
+
+        IEntityStore::getInstance()->queryRect(topLeft, size, [&](const std::shared_ptr<IEntity> &ent)
         {
-            auto it = animators.find(id);
+            if (!lightning->isLit(ent->getPosition()))
+            {
+                return;
+            }
+
+            auto it = animators.find(ent->getId());
 
             if (it == animators.end())
             {
-                continue;
+                return;
             }
 
             auto cur = it->second->getPixelPosition() - center;
 
-            if (cur.x < -(int)frameSize.width || cur.y < -(int)frameSize.height)
+            if (cur.x < -(int)frameSize.width || cur.y < -(int)frameSize.height ||
+                cur.x >= windowWidth || cur.y >= windowHeight)
             {
-                continue;
+                return;
             }
 
             auto imageEntry = it->second->getFrame();
@@ -145,14 +176,17 @@ public:
             SDL_Rect dst = {cur.x, cur.y, (int)frameSize.width, (int)frameSize.height};
 
             SDL_RenderCopy(m_renderer, texture, nullptr, &dst);
-        }
+        });
+
+        // Remembered by the lightning rather than in the store, so checked one by one
 
         for (auto &shadow : lightning->getShadowEntities())
         {
             auto texture = getTextureFromImageEntry(IAnimator::imageEntryFromType(shadow.type));
             auto cur = shadow.pt * frameSize.width - center;
 
-            if (cur.x < -(int)frameSize.width || cur.y < -(int)frameSize.height)
+            if (cur.x < -(int)frameSize.width || cur.y < -(int)frameSize.height ||
+                cur.x >= windowWidth || cur.y >= windowHeight)
             {
                 continue;
             }
@@ -185,6 +219,7 @@ public:
 
         auto gray = getTextureFromImageEntry({Image::GRAY, 0});
         SDL_SetTextureBlendMode(gray, SDL_BLENDMODE_MOD);
+        SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_BLEND);
     }
 
     uint32_t msSince(uint32_t last) override
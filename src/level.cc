@@ -4,6 +4,7 @@
 #include <utils.hh>
 
 #include <algorithm>
+#include <array>
 #include <set>
 #include <unordered_map>
 
@@ -28,6 +29,76 @@ static const std::unordered_map<char, TileType> charToTile =
     {'>', TileType::RIGHT_TRANSPORT},
 };
 
+namespace
+{
+// A step along a ray of the light cone, relative to the light
+struct RayStep
+{
+    int8_t dx;
+    int8_t dy;
+};
+
+// The rays of the light cone in one direction, traced once up front
+struct ConeRays
+{
+    std::vector<RayStep> steps;
+    std::vector<uint8_t> lengths; // Of each ray, in steps
+};
+
+const ConeRays &coneRaysFor(Direction dir)
+{
+    static const auto rays = []()
+    {
+        // This means down
+        const std::vector<point> radius =
+        {
+                     {-1,-2},  {0,-2}, { 1,-2},
+                     {-2,-1},          { 2,-1},
+                     {-3, 0},          { 3, 0},
+                     {-2, 1},          { 1, 2},
+            {-2, 3}, {-1, 3}, { 0, 3}, { 1, 3}, {2, 3},
+                              { 0, 4}
+        };
+        std::array<ConeRays, (int)Direction::NONE + 1> out;
+
+        for (auto cur : {Direction::UP, Direction::DOWN, Direction::LEFT, Direction::RIGHT, Direction::NONE})
+        {
+            auto &rays = out[(int)cur];
+
+            for (auto dst : radius)
+            {
+                if (cur == Direction::UP)
+                {
+                    dst.y *= -1;
+                }
+                else if (cur == Direction::RIGHT)
+                {
+                    std::swap(dst.x, dst.y);
+                }
+                else if (cur == Direction::LEFT)
+                {
+                    std::swap(dst.x, dst.y);
+                    dst.x *= -1;
+                }
+
+                auto before = rays.steps.size();
+                bresenham({0,0}, dst, [&rays](const point &step)
+                {
+                    rays.steps.push_back({(int8_t)step.x, (int8_t)step.y});
+
+                    return BresenhamCallbackRv::CONTINUE_SCANNING;
+                });
+                rays.lengths.push_back(rays.steps.size() - before);
+            }
+        }
+
+        return out;
+    }();
+
+    return rays[(int)dir];
+}
+}
+
 class Level : public ILevel
 {
 public:
@@ -39,11 +110,17 @@ public:
 
     virtual std::optional<TileType> tileAt(const point &where) const override;
 
+    void getNeighborhood(const point &center, Neighborhood<1> &out) const override;
+
+    void getNeighborhood(const point &center, Neighborhood<2> &out) const override;
+
 	virtual void setTile(const point &where, TileType what) override;
 
     virtual void explode(const point &where) override;
 
-    virtual std::set<point> getIllumination(const point &where, Direction dir) override;
+    std::unique_ptr<ObserverCookie> onTileChange(std::function<void(const point &where)> cb) override;
+
+    virtual Illumination getIllumination(const point &where, Direction dir) override;
 
     virtual std::string toString() const override;
 
@@ -51,30 +128,65 @@ public:
     static bool verify(const std::string &data);
 
 private:
+    template<int R>
+    void fillNeighborhood(const point &center, Neighborhood<R> &out) const;
+
     TileType *rawTile(const point &where);
     int pointToIndex(const point &where) const;
 
+    // Keep track of where the light can pass, for the illumination cache
+    void tileChanged(const point &where, TileType before, TileType after);
+    uint32_t opacityGenerationAround(const point &where) const;
+    Illumination illuminate(const point &where, Direction dir) const;
+
     static TileType tileFromChar(char c);
 
     extents m_size;
     std::vector<TileType> m_tiles;
     std::vector<point> m_explosionScanOrder;
+
+    // Blocks of 16x16 tiles, stamped when the translucency in them changes
+    static const int OPACITY_BLOCK_SHIFT = 4;
+    std::vector<uint32_t> m_opacityStamps;
+    unsigned m_opacityBlocksPerRow;
+    uint32_t m_opacityGeneration{0};
+
+    struct CachedIllumination
+    {
+        bool valid{false};
+        point where;
+        Direction dir;
+        uint32_t generation;
+        Illumination result;
+    };
+    std::array<CachedIllumination, 64> m_illuminationCache;
+
+    Notifier<point> m_onTileChange;
+
+    // Sized for this level, so kept for as long as the level is
+    std::shared_ptr<IEntityStore> m_store;
 };
 
 
 Level::Level(extents size, const std::string &data)  :
-    m_size(size)
+    m_size(size),
+    m_store(IEntityStore::getInstance())
 {
     m_tiles.resize(size.height * size.width);
 
+    m_opacityBlocksPerRow = (size.width + (1 << OPACITY_BLOCK_SHIFT) - 1) >> OPACITY_BLOCK_SHIFT;
+    m_opacityStamps.resize(m_opacityBlocksPerRow * ((size.height + (1 << OPACITY_BLOCK_SHIFT) - 1) >> OPACITY_BLOCK_SHIFT));
+
     // Try to create entities for all data
+    std::vector<EntitySpawn> spawns;
     int cur = 0;
     for (auto &c : data)
     {
-        std::shared_ptr<IEntity> ent = IEntity::createFromChar(c, {cur % (int)size.width, cur / (int)size.width});
+        auto type = IEntity::typeFromChar(c);
 
-        if (ent)
+        if (type)
         {
+            spawns.push_back({*type, {cur % (int)size.width, cur / (int)size.width}});
             m_tiles[cur] = TileType::EMPTY;
         }
         else
@@ -84,6 +196,9 @@ Level::Level(extents size, const std::string &data)  :
 
         cur++;
     }
+
+    m_store->setSize(size);
+    m_store->spawnBatch(spawns);
 }
 
 Level::~Level()
@@ -98,13 +213,13 @@ const extents &Level::getSize() const
 int Level::pointToIndex(const point &where) const
 {
     // Dont allow wrapping to the last line
-    if (where.x < 0 || where.y < 0 || where.x >= m_size.width || where.y >= m_size.height)
+    if (where.x < 0 || where.y < 0 || where.x >= (int)m_size.width || where.y >= (int)m_size.height)
     {
         return -1;
     }
 
-    auto idx = where.y * m_size.width + where.x;
-    if (idx < 0 || idx >= m_size.height * m_size.width)
+    auto idx = where.y * (int)m_size.width + where.x;
+    if (idx < 0 || idx >= (int)(m_size.height * m_size.width))
     {
         return -1;
     }
@@ -112,6 +227,30 @@ int Level::pointToIndex(const point &where) const
     return idx;
 }
 
+template<int R>
+void Level::fillNeighborhood(const point &center, Neighborhood<R> &out) const
+{
+    for (int dy = -R; dy <= R; dy++)
+    {
+        for (int dx = -R; dx <= R; dx++)
+        {
+            auto idx = pointToIndex({center.x + dx, center.y + dy});
+
+            out.at(dx, dy).tile = idx < 0 ? Neighborhood<R>::NONE : (uint8_t)m_tiles[idx];
+        }
+    }
+}
+
+void Level::getNeighborhood(const point &center, Neighborhood<1> &out) const
+{
+    fillNeighborhood(center, out);
+}
+
+void Level::getNeighborhood(const point &center, Neighborhood<2> &out) const
+{
+    fillNeighborhood(center, out);
+}
+
 TileType *Level::rawTile(const point &where)
 {
     auto idx = pointToIndex(where);
@@ -145,7 +284,17 @@ void Level::setTile(const point &where, TileType what)
         return;
     }
 
-    m_tiles[idx] = what;
+    if (m_tiles[idx] != what)
+    {
+        tileChanged(where, m_tiles[idx], what);
+        m_tiles[idx] = what;
+        m_onTileChange.invoke(where);
+    }
+}
+
+std::unique_ptr<ObserverCookie> Level::onTileChange(std::function<void(const point &where)> cb)
+{
+    return m_onTileChange.listen(std::move(cb));
 }
 
 void Level::explode(const point &where)
@@ -178,7 +327,7 @@ void Level::explode(const point &where)
 
             auto tile = rawTile(cur);
 
-            if (tile && *tile == TileType::STONE_WALL)
+            if (tile && tileHas(*tile, TILE_BLAST_PROOF))
             {
                 return BresenhamCallbackRv::STOP_SCANNING;
             }
@@ -190,76 +339,109 @@ void Level::explode(const point &where)
         });
     }
 
+    std::vector<EntitySpawn> fireballs;
     for (auto &cur : wreckedPositions)
     {
         auto tile = rawTile(cur);
 
         // destroy this point and create a fireball
-        *tile = TileType::EMPTY;
-        IEntity::createFromType(EntityType::FIREBALL, cur);
+        if (*tile != TileType::EMPTY)
+        {
+            tileChanged(cur, *tile, TileType::EMPTY);
+            *tile = TileType::EMPTY;
+            m_onTileChange.invoke(cur);
+        }
+        fireballs.push_back({EntityType::FIREBALL, cur});
     }
+
+    m_store->spawnBatch(fireballs);
 }
 
-std::set<point> Level::getIllumination(const point &where, Direction dir)
+void Level::tileChanged(const point &where, TileType before, TileType after)
 {
-    std::set<point> out;
-
-    // This means down
-    std::vector<point> radius =
-    {
-             {-1,-2},  {0,-2}, { 1,-2},
-             {-2,-1},          { 2,-1},
-             {-3, 0},          { 3, 0},
-             {-2, 1},          { 1, 2},
-    {-2, 3}, {-1, 3}, { 0, 3}, { 1, 3}, {2, 3},
-                      { 0, 4}
-    };
-    const point center = {0,0};
-
-    if (dir == Direction::UP)
-    {
-        std::for_each(radius.begin(), radius.end(), [](point &cur){ cur.y *= -1; });
-    }
-    else if (dir == Direction::RIGHT)
+    if (tileHas(before, TILE_TRANSLUCENT) == tileHas(after, TILE_TRANSLUCENT))
     {
-        std::for_each(radius.begin(), radius.end(), [](point &cur){ std::swap(cur.x, cur.y); });
+        return;
     }
-    else if (dir == Direction::LEFT)
+
+    auto block = (where.y >> OPACITY_BLOCK_SHIFT) * m_opacityBlocksPerRow + (where.x >> OPACITY_BLOCK_SHIFT);
+    m_opacityStamps[block] = ++m_opacityGeneration;
+}
+
+uint32_t Level::opacityGenerationAround(const point &where) const
+{
+    // The blocks the light cone can reach, at most 2x2 of them
+    auto x0 = std::max(where.x - Illumination::RADIUS, 0) >> OPACITY_BLOCK_SHIFT;
+    auto y0 = std::max(where.y - Illumination::RADIUS, 0) >> OPACITY_BLOCK_SHIFT;
+    auto x1 = std::min(where.x + Illumination::RADIUS, (int)m_size.width - 1) >> OPACITY_BLOCK_SHIFT;
+    auto y1 = std::min(where.y + Illumination::RADIUS, (int)m_size.height - 1) >> OPACITY_BLOCK_SHIFT;
+    uint32_t out = 0;
+
+    for (auto y = y0; y <= y1; y++)
     {
-        std::for_each(radius.begin(), radius.end(), [](point &cur){ std::swap(cur.x, cur.y); cur.x *= -1; });
+        for (auto x = x0; x <= x1; x++)
+        {
+            out = std::max(out, m_opacityStamps[y * m_opacityBlocksPerRow + x]);
+        }
     }
 
-    auto src = where + center;
-    for (auto &it : radius)
+    return out;
+}
+
+Illumination Level::illuminate(const point &where, Direction dir) const
+{
+    Illumination out;
+    out.origin = where;
+
+    const auto &rays = coneRaysFor(dir);
+    auto step = rays.steps.begin();
+
+    for (auto length : rays.lengths)
     {
-        auto dst = where + it;
+        auto end = step + length;
 
-        bresenham(src, dst, [this, &out](const point &cur)
+        for (; step != end; ++step)
         {
+            point cur = {where.x + step->dx, where.y + step->dy};
+
             // Skip out-of-bounds stuff
             auto idx = pointToIndex(cur);
             if (idx < 0)
             {
-                return BresenhamCallbackRv::STOP_SCANNING;
+                break;
             }
 
-            auto tile = rawTile(cur);
-
             // We can light that!
-            out.insert(cur);
+            out.set(cur);
 
-            if (*tile != TileType::DIRT && *tile != TileType::EMPTY)
+            if (!tileHas(m_tiles[idx], TILE_TRANSLUCENT))
             {
-                return BresenhamCallbackRv::STOP_SCANNING;
+                break;
             }
-
-            return BresenhamCallbackRv::CONTINUE_SCANNING;
-        });
+        }
+        step = end;
     }
 
     return out;
 }
 
+Illumination Level::getIllumination(const point &where, Direction dir)
+{
+    auto &cached = m_illuminationCache[((unsigned)where.x * 31 + (unsigned)where.y * 5 + (unsigned)dir) % m_illuminationCache.size()];
+
+    if (!cached.valid || cached.where != where || cached.dir != dir ||
+        opacityGenerationAround(where) > cached.generation)
+    {
+        cached.valid = true;
+        cached.where = where;
+        cached.dir = dir;
+        cached.generation = m_opacityGeneration;
+        cached.result = illuminate(where, dir);
+    }
+
+    return cached.result;
+}
+
 // Assumes the level has been verified
 TileType Level::tileFromChar(char c)
 {
@@ -350,9 +532,9 @@ std::string Level::toString() const
 {
     std::string out;
 
-    for (auto y = 0; y < m_size.height; y++)
+    for (auto y = 0; y < (int)m_size.height; y++)
     {
-        for (auto x = 0; x < m_size.width; x++)
+        for (auto x = 0; x < (int)m_size.width; x++)
         {
             const auto tile = m_tiles[y * m_size.width + x];
             auto it = tileToChar.find(tile);
@@ -374,10 +556,5 @@ std::string Level::toString() const
 
 bool ILevel::tileIsPassable(TileType what)
 {
-    if (what == TileType::DIRT || what == TileType::EMPTY || what == TileType::TELEPORTER)
-    {
-        return true;
-    }
-
-    return false;
+    return tileHas(what, TILE_PASSABLE);
 }
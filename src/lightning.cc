@@ -1,5 +1,34 @@
 #include <lightning.hh>
 
+#include <unordered_map>
+
+static_assert(TILE_TYPE_COUNT <= 16, "Remembered tiles are stored in 4 bits");
+
+namespace
+{
+// std::hash<point> collides a lot for the many shadows of a large level
+struct ShadowHash
+{
+    std::size_t operator()(const point &where) const
+    {
+        return std::hash<uint64_t>()(((uint64_t)(uint32_t)where.y << 32) | (uint32_t)where.x);
+    }
+};
+
+// How much a light source lights up the tiles around it, fading with the distance
+constexpr int GLOW_RADIUS = 2;
+constexpr uint8_t GLOW[2 * GLOW_RADIUS + 1][2 * GLOW_RADIUS + 1] =
+{
+    {1, 1, 1, 1, 1},
+    {1, 2, 2, 2, 1},
+    {1, 2, 3, 2, 1},
+    {1, 2, 2, 2, 1},
+    {1, 1, 1, 1, 1},
+};
+static_assert(GLOW[GLOW_RADIUS][GLOW_RADIUS] == ILightning::LIGHT_FULL, "Full light at the source");
+// With at most one source per tile, a tile sums up to 35, which fits in a byte
+}
+
 class Lightning : public ILightning
 {
 public:
@@ -8,12 +37,47 @@ public:
         m_level(level),
         m_store(IEntityStore::getInstance())
     {
-        m_tiles.resize(m_size.width * m_size.height);
-        std::fill(m_tiles.begin(), m_tiles.end(), TileType::UNKNOWN);
+        m_lit.resize(m_size);
+        m_seen.resize(m_size);
+        m_memory.resize((m_size.width * m_size.height + 1) / 2);
+
+        m_occupancyCookie = m_store->onOccupancyChange([this](const point &where)
+        {
+            if (!m_hideUnknown)
+            {
+                m_occupancyChanges.push_back(where);
+            }
+        });
+
+        // Light sources, those in the level and those which come later
+        for (unsigned type = 0; type < ENTITY_TYPE_COUNT; type++)
+        {
+            if (entityHas((EntityType)type, ENTITY_GLOWING))
+            {
+                m_store->forEachOfType((EntityType)type, [this](const std::shared_ptr<IEntity> &ent)
+                {
+                    m_newLightSources.push_back(ent->getId());
+                });
+            }
+        }
+        m_creationCookie = m_store->onCreation([this](const std::shared_ptr<IEntity> &ent)
+        {
+            addLightSource(ent);
+        });
+        m_batchCreationCookie = m_store->onBatchCreation([this](const std::vector<std::shared_ptr<IEntity>> &entities)
+        {
+            for (auto &ent : entities)
+            {
+                addLightSource(ent);
+            }
+        });
     }
 
-    void updateLightning(const std::set<point> &lighted) override
+    void updateLightning(const Illumination &lighted) override
     {
+        updateVisibility(lighted);
+        updateLightSources();
+
         if (m_hideUnknown)
         {
             updateLightningHideUnknown(lighted);
@@ -22,44 +86,39 @@ public:
         {
             updateLightningShowUnknown(lighted);
         }
-    }
 
-    void updateLightningShowUnknown(const std::set<point> &lighted)
-    {
         m_lighted = lighted;
+    }
 
-        m_visibleEntities.clear();
-        m_shadowEntities.clear();
-        for (auto ent : m_store->getEntities())
+    void updateLightningShowUnknown(const Illumination &lighted)
+    {
+        // Entities in what went dark, or which moved, might be in the shadows now
+        m_lighted.forEach([this](const point &pt)
         {
-            auto pos = ent->getPosition();
-            if (lighted.find(pos) == lighted.end())
-            {
-                m_shadowEntities[pos] = ent->getType();
-            }
-            else
-            {
-                m_visibleEntities.push_back(ent->getId());
-            }
+            refreshShadow(pt);
+        });
+        for (auto &pt : m_occupancyChanges)
+        {
+            refreshShadow(pt);
         }
+        m_occupancyChanges.clear();
 
         // Update visible tiles and entities
-        for (auto pt : lighted)
+        lighted.forEach([this](const point &pt)
         {
-            m_shadowEntities.erase(pt);
+            clearShadow(pt);
 
             auto tile = m_level->tileAt(pt);
             if (tile)
             {
-                m_tiles[pt.y * m_size.width + pt.x] = *tile;
+                remember(pt, *tile);
             }
-        }
+        });
+        updateVisibleEntities(lighted);
     }
 
-    void updateLightningHideUnknown(const std::set<point> &lighted)
+    void updateLightningHideUnknown(const Illumination &lighted)
     {
-        m_lighted = lighted;
-
         for (auto entId : m_visibleEntities)
         {
             auto ent = m_store->getEntityById(entId);
@@ -70,49 +129,75 @@ public:
          
             auto pos = ent->getPosition();
 
-            if (lighted.find(pos) == lighted.end())
+            if (!lighted.isLit(pos))
             {
-                m_shadowEntities[pos] = ent->getType();
+                setShadow(pos, ent->getType());
             }
         }
 
-        m_visibleEntities.clear();
-
         // Update visible tiles and entities
-        for (auto pt : lighted)
+        lighted.forEach([this](const point &pt)
         {
-            m_shadowEntities.erase(pt);
+            clearShadow(pt);
 
             auto tile = m_level->tileAt(pt);
             if (tile)
             {
-                m_tiles[pt.y * m_size.width + pt.x] = *tile;
+                remember(pt, *tile);
             }
+        });
+        updateVisibleEntities(lighted);
+    }
 
-            auto ent = m_store->getEntityByPoint(pt);
-            if (ent)
-            {
-                // The entity is visible, add to the visible set
-                m_visibleEntities.push_back(ent->getId());
-            }
-        }
+    const Bitboard &getLit() const override
+    {
+        return m_lit;
+    }
+
+    const Bitboard &getSeen() const override
+    {
+        return m_seen;
+    }
+
+    bool isLit(const point &where) const override
+    {
+        return m_lit.test(where);
     }
 
-    const std::set<point> getLighted() const override
+    bool isSeen(const point &where) const override
     {
-        return m_lighted;
+        return m_seen.test(where);
+    }
+
+    unsigned getLightLevel(const point &where) const override
+    {
+        auto idx = pointToIndex(where);
+
+        if (idx < 0 || m_lightMap.empty())
+        {
+            return 0;
+        }
+
+        return std::min<unsigned>(m_lightMap[idx], LIGHT_FULL);
     }
 
     std::optional<TileType> tileAt(const point &where) const override
     {
+        auto idx = pointToIndex(where);
+
         // Bounds check
-        if (!m_level->tileAt(where))
+        if (idx < 0)
         {
             return std::optional<TileType>();
         }
         if (m_hideUnknown)
         {
-            return m_tiles[where.y * m_size.width + where.x];
+            if (!m_seen.test(where))
+            {
+                return TileType::UNKNOWN;
+            }
+
+            return (TileType)((m_memory[idx / 2] >> (idx % 2 * 4)) & 0xf);
         }
 
         return m_level->tileAt(where);
@@ -123,16 +208,9 @@ public:
         return m_visibleEntities;
     }
 
-    std::vector<ShadowEntity> getShadowEntities()  override
+    const std::vector<ShadowEntity> &getShadowEntities()  override
     {
-        std::vector<ShadowEntity> out;
-
-        for (auto &[pt, type] : m_shadowEntities)
-        {
-            out.push_back({pt, type});
-        }
-
-        return out;
+        return m_shadowEntities;
     }
 
 
@@ -142,21 +220,244 @@ public:
         {
             m_hideUnknown = true;
         }
-        else
+        else if (m_hideUnknown)
         {
             m_hideUnknown = false;
+
+            // Forget what was remembered in the dark, and from here on, only
+            // track the changes
+            m_occupancyChanges.clear();
+            m_shadowEntities.clear();
+            m_shadowIndex.clear();
+            m_store->forEachEntity([this](const std::shared_ptr<IEntity> &ent)
+            {
+                auto pos = ent->getPosition();
+
+                if (!isLit(pos))
+                {
+                    setShadow(pos, ent->getType());
+                }
+            });
         }
     }
 
 private:
+    struct LightSource
+    {
+        uint32_t id;
+        point where;
+    };
+
+    // The glow of a light source to add (or take away) at a point
+    struct Glow
+    {
+        point where;
+        int sign;
+    };
+
+    // The entities within the window of the light cone, which are in the light
+    void updateVisibleEntities(const Illumination &lighted)
+    {
+        const point topLeft = {lighted.origin.x - Illumination::RADIUS, lighted.origin.y - Illumination::RADIUS};
+
+        m_visibleEntities.clear();
+        m_store->queryRect(topLeft, {Illumination::SIDE, Illumination::SIDE}, [this, &lighted](const std::shared_ptr<IEntity> &ent)
+        {
+            if (lighted.isLit(ent->getPosition()))
+            {
+                m_visibleEntities.push_back(ent->getId());
+            }
+        });
+    }
+
+    void addLightSource(const std::shared_ptr<IEntity> &ent)
+    {
+        if (entityHas(ent->getType(), ENTITY_GLOWING))
+        {
+            m_newLightSources.push_back(ent->getId());
+        }
+    }
+
+    // Move the glow of the sources which moved, went out or were lit since the last time
+    void updateLightSources()
+    {
+        m_glows.clear();
+
+        size_t kept = 0;
+        for (auto &cur : m_lightSources)
+        {
+            auto ent = m_store->getEntityById(cur.id);
+
+            if (ent && ent->getPosition() == cur.where)
+            {
+                m_lightSources[kept++] = cur;
+                continue;
+            }
+
+            m_glows.push_back({cur.where, -1});
+            if (ent)
+            {
+                m_glows.push_back({ent->getPosition(), 1});
+                m_lightSources[kept++] = {cur.id, ent->getPosition()};
+            }
+        }
+        m_lightSources.resize(kept);
+
+        for (auto id : m_newLightSources)
+        {
+            auto ent = m_store->getEntityById(id);
+
+            if (ent)
+            {
+                m_glows.push_back({ent->getPosition(), 1});
+                m_lightSources.push_back({id, ent->getPosition()});
+            }
+        }
+        m_newLightSources.clear();
+
+        if (!m_glows.empty())
+        {
+            accumulateGlows();
+        }
+    }
+
+    // All the changes in one pass over the light map
+    void accumulateGlows()
+    {
+        if (m_lightMap.empty())
+        {
+            // Most levels are dark until something explodes
+            m_lightMap.resize(m_size.width * m_size.height);
+        }
+
+        for (auto &cur : m_glows)
+        {
+            auto x0 = std::max(cur.where.x - GLOW_RADIUS, 0);
+            auto x1 = std::min(cur.where.x + GLOW_RADIUS, (int)m_size.width - 1);
+            auto y0 = std::max(cur.where.y - GLOW_RADIUS, 0);
+            auto y1 = std::min(cur.where.y + GLOW_RADIUS, (int)m_size.height - 1);
+
+            for (auto y = y0; y <= y1; y++)
+            {
+                auto row = &m_lightMap[y * m_size.width];
+                auto glow = GLOW[y - cur.where.y + GLOW_RADIUS];
+
+                for (auto x = x0; x <= x1; x++)
+                {
+                    row[x] += cur.sign * glow[x - cur.where.x + GLOW_RADIUS];
+                }
+            }
+        }
+    }
+
+    int pointToIndex(const point &where) const
+    {
+        if (where.x < 0 || where.y < 0 || where.x >= (int)m_size.width || where.y >= (int)m_size.height)
+        {
+            return -1;
+        }
+
+        return where.y * (int)m_size.width + where.x;
+    }
+
+    // The tile last seen at a point, packed two to a byte
+    void remember(const point &where, TileType tile)
+    {
+        auto idx = pointToIndex(where);
+        auto &packed = m_memory[idx / 2];
+        auto shift = idx % 2 * 4;
+
+        packed = (packed & ~(0xf << shift)) | ((uint8_t)tile << shift);
+    }
+
+    void setShadow(const point &where, EntityType type)
+    {
+        auto it = m_shadowIndex.find(where);
+
+        if (it != m_shadowIndex.end())
+        {
+            m_shadowEntities[it->second].type = type;
+            return;
+        }
+
+        m_shadowIndex.emplace(where, m_shadowEntities.size());
+        m_shadowEntities.push_back({where, type});
+    }
+
+    void clearShadow(const point &where)
+    {
+        auto it = m_shadowIndex.find(where);
+
+        if (it == m_shadowIndex.end())
+        {
+            return;
+        }
+
+        // Fill the hole with the last one to keep them contiguous
+        auto idx = it->second;
+        m_shadowIndex.erase(it);
+
+        if (idx != m_shadowEntities.size() - 1)
+        {
+            m_shadowEntities[idx] = m_shadowEntities.back();
+            m_shadowIndex[m_shadowEntities[idx].pt] = idx;
+        }
+        m_shadowEntities.pop_back();
+    }
+
+    // Show what's at an unlit point as a shadow
+    void refreshShadow(const point &where)
+    {
+        auto ent = isLit(where) ? nullptr : m_store->getEntityByPoint(where);
+
+        if (ent)
+        {
+            setShadow(where, ent->getType());
+        }
+        else
+        {
+            clearShadow(where);
+        }
+    }
+
+    // Only the tiles which go dark or become lit are touched
+    void updateVisibility(const Illumination &lighted)
+    {
+        m_lighted.forEach([this](const point &pt)
+        {
+            m_lit.set(pt, false);
+        });
+
+        lighted.forEach([this](const point &pt)
+        {
+            m_lit.set(pt, true);
+            m_seen.set(pt, true);
+        });
+    }
+
     const extents m_size;
     std::shared_ptr<ILevel> m_level;
-    std::vector<TileType> m_tiles;
+    Bitboard m_lit;
+    Bitboard m_seen;
+    std::vector<uint8_t> m_memory;
     std::vector<uint32_t> m_visibleEntities;
-    std::unordered_map<point, EntityType> m_shadowEntities;
-    std::set<point> m_lighted;
+    Illumination m_lighted;
+
+    // Kept contiguous, with the index of each by position
+    std::vector<ShadowEntity> m_shadowEntities;
+    std::unordered_map<point, uint32_t, ShadowHash> m_shadowIndex;
 
     std::shared_ptr<IEntityStore> m_store;
+    std::vector<point> m_occupancyChanges;
+    std::unique_ptr<ObserverCookie> m_occupancyCookie;
+
+    // Sums of the glows of the light sources, per tile
+    std::vector<uint8_t> m_lightMap;
+    std::vector<LightSource> m_lightSources;
+    std::vector<uint32_t> m_newLightSources;
+    std::vector<Glow> m_glows;
+    std::unique_ptr<ObserverCookie> m_creationCookie;
+    std::unique_ptr<ObserverCookie> m_batchCreationCookie;
     bool m_hideUnknown{true};
 };
 
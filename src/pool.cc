@@ -0,0 +1,118 @@
+#include <pool.hh>
+
+#include <cstdlib>
+
+// Size classes are multiples of GRANULARITY up to MAX_POOLED_SIZE, larger
+// allocations go directly to operator new
+static const std::size_t GRANULARITY = 16;
+static const std::size_t MAX_POOLED_SIZE = 512;
+static const std::size_t N_POOLS = MAX_POOLED_SIZE / GRANULARITY;
+static const std::size_t SLAB_SIZE = 16 * 1024;
+
+static BlockPool::Stats g_largeStats;
+
+BlockPool *BlockPool::forSize(std::size_t size)
+{
+    // Never freed, so objects can outlive the static destructors
+    static BlockPool *g_pools = []()
+    {
+        auto out = new BlockPool[N_POOLS];
+
+        for (std::size_t i = 0; i < N_POOLS; i++)
+        {
+            out[i].m_blockSize = (i + 1) * GRANULARITY;
+        }
+
+        return out;
+    }();
+
+    if (size == 0 || size > MAX_POOLED_SIZE)
+    {
+        return nullptr;
+    }
+
+    return &g_pools[(size - 1) / GRANULARITY];
+}
+
+void *BlockPool::allocate()
+{
+    if (!m_free)
+    {
+        refill();
+        m_stats.misses++;
+    }
+    else
+    {
+        m_stats.hits++;
+    }
+
+    auto out = m_free;
+    m_free = out->next;
+
+    return out;
+}
+
+void BlockPool::deallocate(void *p)
+{
+    auto block = static_cast<FreeBlock *>(p);
+
+    block->next = m_free;
+    m_free = block;
+}
+
+void BlockPool::refill()
+{
+    auto slab = static_cast<char *>(std::malloc(SLAB_SIZE));
+    if (!slab)
+    {
+        throw std::bad_alloc();
+    }
+    m_stats.slabs++;
+
+    for (std::size_t offset = 0; offset + m_blockSize <= SLAB_SIZE; offset += m_blockSize)
+    {
+        deallocate(slab + offset);
+    }
+}
+
+void *BlockPool::allocate(std::size_t size)
+{
+    auto pool = forSize(size);
+
+    if (!pool)
+    {
+        g_largeStats.misses++;
+        return ::operator new(size);
+    }
+
+    return pool->allocate();
+}
+
+void BlockPool::deallocate(void *p, std::size_t size)
+{
+    auto pool = forSize(size);
+
+    if (!pool)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    pool->deallocate(p);
+}
+
+BlockPool::Stats BlockPool::getStats()
+{
+    auto out = g_largeStats;
+
+    for (std::size_t i = 1; i <= N_POOLS; i++)
+    {
+        auto &cur = forSize(i * GRANULARITY)->m_stats;
+
+        out.hits += cur.hits;
+        out.misses += cur.misses;
+        out.slabs += cur.slabs;
+    }
+
+    return out;
+}
@@ -0,0 +1,322 @@
+#include <io.hh>
+#include <input.hh>
+#include <game.hh>
+#include <entity.hh>
+#include <resource-store.hh>
+#include <pool.hh>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Headless driver: no display, no delays, player input from a script
+
+class NullIo : public IIo
+{
+public:
+    void setup(uint32_t windowWidth, uint32_t windowHeight) override
+    {
+    }
+
+    void display(const std::shared_ptr<IEntity> center, std::shared_ptr<ILevel> level,
+        const std::shared_ptr<ILightning> lightning, std::shared_ptr<ILevelAnimator> levelAnimator,
+        const std::unordered_map<uint32_t, std::shared_ptr<IAnimator>> &animators) override
+    {
+    }
+
+    uint32_t msSince(uint32_t last) override
+    {
+        return 0;
+    }
+
+    void delay(uint32_t ms) override
+    {
+    }
+};
+
+class ScriptedInput : public IInput
+{
+public:
+    // One character per tick: u/d/l/r walks, U/D/L/R operates and anything else idles
+    void setScript(const std::string &script)
+    {
+        m_keys.clear();
+
+        for (auto c : script)
+        {
+            uint32_t keys = 0;
+
+            switch (c)
+            {
+            case 'u': case 'U': keys = InputTypes::UP; break;
+            case 'd': case 'D': keys = InputTypes::DOWN; break;
+            case 'l': case 'L': keys = InputTypes::LEFT; break;
+            case 'r': case 'R': keys = InputTypes::RIGHT; break;
+            default:
+                break;
+            }
+            if (keys && c >= 'A' && c <= 'Z')
+            {
+                keys |= InputTypes::OPERATE;
+            }
+
+            m_keys.push_back(keys);
+        }
+    }
+
+    // The script loops when it runs out
+    void setTick(unsigned tick)
+    {
+        m_tick = tick;
+    }
+
+    uint32_t getInput() override
+    {
+        if (m_keys.empty())
+        {
+            return 0;
+        }
+
+        return m_keys[m_tick % m_keys.size()];
+    }
+
+private:
+    std::vector<uint32_t> m_keys;
+    unsigned m_tick{0};
+};
+
+class NullResourceStore : public IResourceStore
+{
+public:
+    void addImage(Image image, const std::string &filename) override
+    {
+    }
+
+    unsigned getImageFrameCount(Image image) const override
+    {
+        return 1;
+    }
+
+    void *getImageFrame(const ImageEntry &entry) override
+    {
+        return nullptr;
+    }
+
+    extents getFrameExtents() const override
+    {
+        return {16, 16};
+    }
+};
+
+static std::shared_ptr<ScriptedInput> g_input = std::make_shared<ScriptedInput>();
+
+std::shared_ptr<IIo> IIo::getInstance()
+{
+    static auto g_instance = std::make_shared<NullIo>();
+
+    return g_instance;
+}
+
+std::shared_ptr<IResourceStore> IResourceStore::getInstance()
+{
+    static auto g_instance = std::make_shared<NullResourceStore>();
+
+    return g_instance;
+}
+
+std::shared_ptr<IInput> IInput::fromEntity(std::shared_ptr<IEntity> entity)
+{
+    if (entity->getType() != EntityType::PLAYER)
+    {
+        return nullptr;
+    }
+
+    return g_input;
+}
+
+
+// A random level with the player in the middle
+static std::string generateLevel(unsigned width, unsigned height)
+{
+    std::string out = std::to_string(width) + " " + std::to_string(height) + " ";
+
+    for (unsigned y = 0; y < height; y++)
+    {
+        for (unsigned x = 0; x < width; x++)
+        {
+            auto r = random() % 100;
+            char c = '.';
+
+            if (x == width / 2 && y == height / 2)
+            {
+                c = 'p';
+            }
+            else if (x == 0 || y == 0 || x == width - 1 || y == height - 1)
+            {
+                c = '#';
+            }
+            else if (r < 12)
+            {
+                c = 'o';
+            }
+            else if (r < 16)
+            {
+                c = 'd';
+            }
+            else if (r < 28)
+            {
+                c = ' ';
+            }
+            else if (r < 29)
+            {
+                c = 'g';
+            }
+
+            out += c;
+        }
+    }
+
+    return out;
+}
+
+static std::string readLevel(const std::string &filename)
+{
+    std::ifstream ifs(filename);
+    if (!ifs.is_open())
+    {
+        return "";
+    }
+
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+
+    return ss.str();
+}
+
+// Independent of the entity order, to compare runs with different scheduling
+static uint32_t worldChecksum()
+{
+    std::vector<std::tuple<int, int, int>> entities;
+
+    IEntityStore::getInstance()->forEachEntity([&entities](const std::shared_ptr<IEntity> &entity)
+    {
+        auto where = entity->getPosition();
+
+        entities.emplace_back(where.y, where.x, (int)entity->getType());
+    });
+    std::sort(entities.begin(), entities.end());
+
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+    auto add = [&hash](int v)
+    {
+        hash = (hash ^ (uint32_t)v) * 16777619U;
+    };
+
+    for (auto &cur : entities)
+    {
+        add(std::get<0>(cur));
+        add(std::get<1>(cur));
+        add(std::get<2>(cur));
+    }
+
+    return hash;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-t ticks] [-i input-script] [-s seed] [-j threads] <level-file | WIDTHxHEIGHT>\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned maxTicks = 1000;
+    unsigned seed = 1;
+    unsigned threads = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:i:s:j:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            maxTicks = strtoul(optarg, nullptr, 0);
+            break;
+        case 'i':
+            g_input->setScript(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, nullptr, 0);
+            break;
+        case 'j':
+            threads = strtoul(optarg, nullptr, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+    }
+    srandom(seed);
+
+    std::string levelData;
+    unsigned width, height;
+    char dummy;
+
+    if (sscanf(argv[optind], "%u%c%u", &width, &dummy, &height) == 3 && dummy == 'x')
+    {
+        levelData = generateLevel(width, height);
+    }
+    else
+    {
+        levelData = readLevel(argv[optind]);
+    }
+
+    auto game = IGame::createHeadless(maxTicks);
+    game->setThreads(threads);
+
+    auto before = std::chrono::steady_clock::now();
+    if (!game->setLevel(levelData))
+    {
+        printf("Invalid level\n");
+        return 1;
+    }
+    auto loaded = std::chrono::steady_clock::now();
+
+    unsigned ticks = 0;
+    auto cookie = game->onTick([&ticks](unsigned tick)
+    {
+        ticks = tick;
+        g_input->setTick(tick);
+    });
+
+    auto rv = game->play();
+    auto after = std::chrono::steady_clock::now();
+
+    auto loadSeconds = std::chrono::duration<double>(loaded - before).count();
+    auto playSeconds = std::chrono::duration<double>(after - loaded).count();
+
+    printf("Level loaded in %.3f s\n", loadSeconds);
+    printf("%u ticks in %.3f s: %.1f ticks/s (player %s)\n", ticks, playSeconds,
+        playSeconds > 0 ? ticks / playSeconds : 0.0,
+        rv ? "alive" : "dead");
+    printf("World checksum: %08x\n", worldChecksum());
+
+    auto stats = BlockPool::getStats();
+    printf("Pool allocations: %llu hits, %llu misses, %llu slabs\n",
+        (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.slabs);
+
+    return 0;
+}
@@ -1,63 +1,111 @@
 #include <behavior.hh>
 #include "itrait.hh"
 
+#include <array>
 #include <memory>
 #include <vector>
-#include <functional>
 
-class CollisionTrait : public ITrait
+namespace collision
 {
-public:
-    CollisionTrait()
-    {
-        auto store = IEntityStore::getInstance();
+    using Handler = void (*)(const std::shared_ptr<IEntity> &one, const std::shared_ptr<IEntity> &other);
 
-        m_cookie = store->onCollision([this](std::shared_ptr<IEntity> one, std::shared_ptr<IEntity> other){onCollision(one, other);});
+    // Indexed by the types of the two colliding entities
+    using Matrix = std::array<std::array<Handler, ENTITY_TYPE_COUNT>, ENTITY_TYPE_COUNT>;
+
+    static void removeOne(const std::shared_ptr<IEntity> &one, const std::shared_ptr<IEntity> &other)
+    {
+        one->remove();
     }
 
-    bool run(unsigned ms) override
+    static void removeOther(const std::shared_ptr<IEntity> &one, const std::shared_ptr<IEntity> &other)
     {
-        // Handled in the callback
-        return false;
+        other->remove();
     }
 
-    void onCollision(std::shared_ptr<IEntity> one, std::shared_ptr<IEntity> other)
+    // @a handler for @a type colliding with anything, or @a swapped when @a type is the other entity
+    static constexpr void ifOne(Matrix &matrix, EntityType type, Handler handler, Handler swapped)
     {
-        ifOne(one, other, EntityType::FIREBALL,
-            [](std::shared_ptr<IEntity> which)
+        for (unsigned i = 0; i < ENTITY_TYPE_COUNT; i++)
         {
-            which->remove();
-        });
-
-        // More to come
+            if (!matrix[(unsigned)type][i])
+            {
+                matrix[(unsigned)type][i] = handler;
+            }
+            if (!matrix[i][(unsigned)type])
+            {
+                matrix[i][(unsigned)type] = swapped;
+            }
+        }
     }
 
-private:
-    void ifOne(std::shared_ptr<IEntity> one, std::shared_ptr<IEntity> other, EntityType type,
-        std::function<void(std::shared_ptr<IEntity>)> onTrue) const
+    // @a handler for @a type colliding with @a type2, or @a swapped the other way around
+    static constexpr void ifPair(Matrix &matrix, EntityType type, EntityType type2, Handler handler, Handler swapped)
     {
-        if (one->getType() == type)
+        if (!matrix[(unsigned)type][(unsigned)type2])
         {
-            onTrue(other);
+            matrix[(unsigned)type][(unsigned)type2] = handler;
         }
-        else if (other->getType() == type)
+        if (!matrix[(unsigned)type2][(unsigned)type])
         {
-            onTrue(one);
+            matrix[(unsigned)type2][(unsigned)type] = swapped;
         }
     }
 
-    void ifPair(std::shared_ptr<IEntity> one, std::shared_ptr<IEntity> other, EntityType type, EntityType type2,
-        std::function<void(std::shared_ptr<IEntity>)> onTrue) const
+    // The collision rules. Earlier rules take precedence
+    static constexpr Matrix makeHandlers()
+    {
+        Matrix matrix{};
+
+        // Fireballs burn whatever they hit
+        ifOne(matrix, EntityType::FIREBALL, removeOther, removeOne);
+
+        // More to come
+
+        return matrix;
+    }
+}
+
+static constexpr collision::Matrix g_collisionHandlers = collision::makeHandlers();
+
+class CollisionTrait : public ITrait
+{
+public:
+    CollisionTrait() :
+        m_store(IEntityStore::getInstance())
     {
-        if (one->getType() == type && other->getType() == type2)
+        m_cookie = m_store->onCollisions([this](const std::vector<CollisionEvent> &events)
         {
-            onTrue(other);
-        }
-        else if (other->getType() == type && one->getType() == type2)
+            for (auto &ev : events)
+            {
+                auto one = m_store->getEntityById(ev.one);
+                auto other = m_store->getEntityById(ev.other);
+
+                // Might have been removed by an earlier collision
+                if (one && other)
+                {
+                    onCollision(one, other);
+                }
+            }
+        });
+    }
+
+    bool run(unsigned ms) override
+    {
+        // Handled in the callback
+        return false;
+    }
+
+    void onCollision(const std::shared_ptr<IEntity> &one, const std::shared_ptr<IEntity> &other)
+    {
+        auto handler = g_collisionHandlers[(unsigned)one->getType()][(unsigned)other->getType()];
+
+        if (handler)
         {
-            onTrue(one);
+            handler(one, other);
         }
     }
 
+private:
+    std::shared_ptr<IEntityStore> m_store;
     std::unique_ptr<ObserverCookie> m_cookie;
 };
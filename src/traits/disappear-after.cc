@@ -23,12 +23,22 @@ public:
         // The time has expired, so remove
         if (m_timeLeft <= 0)
         {
-            m_entity->remove();
+            expire();
         }
 
         return false;
     }
 
+    int getTimeLeft() const
+    {
+        return m_timeLeft;
+    }
+
+    void expire()
+    {
+        m_entity->remove();
+    }
+
 private:
     int m_timeLeft;
     std::shared_ptr<IEntity> m_entity;
@@ -25,15 +25,25 @@ public:
         // The time has expired, so explode!
         if (m_timeLeft <= 0)
         {
-            auto where = m_entity->getPosition();
-
-            m_entity->remove();
-            m_level->explode(where);
+            expire();
         }
 
         return false;
     }
 
+    int getTimeLeft() const
+    {
+        return m_timeLeft;
+    }
+
+    void expire()
+    {
+        auto where = m_entity->getPosition();
+
+        m_entity->remove();
+        m_level->explode(where);
+    }
+
 private:
     int m_timeLeft;
     std::shared_ptr<ILevel> m_level;
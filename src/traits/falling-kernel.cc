@@ -0,0 +1,161 @@
+#include <bitboard.hh>
+#include <entity.hh>
+#include <level.hh>
+#include <point.hh>
+#include <worker-pool.hh>
+
+#include <memory>
+#include <vector>
+
+/**
+ * The FallTrait rules evaluated 64 cells at a time. Bitboards of what the
+ * rules look at are kept up to date from tile and occupancy changes, and
+ * give the intent of every cell in a row with a few word operations. The
+ * intents are the same as FallTrait::plan() gives for the same level.
+ */
+class FallKernel
+{
+public:
+    FallKernel(std::shared_ptr<ILevel> level) :
+        m_level(level),
+        m_store(IEntityStore::getInstance())
+    {
+        auto &size = level->getSize();
+
+        for (auto board : {&m_empty, &m_rounded, &m_crushable, &m_crush, &m_slideLeft, &m_slideRight, &m_fall})
+        {
+            board->resize(size);
+        }
+
+        for (int y = 0; y < (int)size.height; y++)
+        {
+            for (int x = 0; x < (int)size.width; x++)
+            {
+                update({x, y});
+            }
+        }
+
+        m_tileCookie = level->onTileChange([this](const point &where)
+        {
+            update(where);
+        });
+        m_occupancyCookie = m_store->onOccupancyChange([this](const point &where)
+        {
+            update(where);
+        });
+    }
+
+    /// Evaluate the rules for all cells of @a rows, in stripes on @a workers if given
+    void prepare(const std::vector<int> &rows, IWorkerPool *workers)
+    {
+        auto job = [this, &rows](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                prepareRow(rows[i]);
+            }
+        };
+
+        if (workers)
+        {
+            workers->forEachStripe(rows.size(), job);
+        }
+        else
+        {
+            job(0, rows.size());
+        }
+    }
+
+    /// What FallTrait::plan() would give at @a where, for a prepared row
+    FallTrait::Intent intentAt(const point &where, bool falling) const
+    {
+        if (falling && m_crush.test(where))
+        {
+            return FallTrait::Intent::CRUSH;
+        }
+        else if (m_slideLeft.test(where))
+        {
+            return FallTrait::Intent::SLIDE_LEFT;
+        }
+        else if (m_slideRight.test(where))
+        {
+            return FallTrait::Intent::SLIDE_RIGHT;
+        }
+        else if (m_fall.test(where))
+        {
+            return FallTrait::Intent::FALL;
+        }
+
+        return FallTrait::Intent::STAY;
+    }
+
+private:
+    void update(const point &where)
+    {
+        auto tile = m_level->tileAt(where);
+        auto entity = m_store->getEntityByPoint(where);
+        auto attributes = entity ? ENTITY_ATTRIBUTES[(unsigned)entity->getType()] : 0;
+
+        m_empty.set(where, !entity && tile && tileHas(*tile, TILE_OPEN));
+        m_rounded.set(where, attributes & ENTITY_ROUNDED);
+        m_crushable.set(where, attributes & ENTITY_CRUSHABLE);
+    }
+
+    void prepareRow(int y)
+    {
+        auto words = m_empty.getWordsPerRow();
+        auto crush = m_crush.row(y);
+        auto slideLeft = m_slideLeft.row(y);
+        auto slideRight = m_slideRight.row(y);
+        auto fall = m_fall.row(y);
+
+        if (!crush)
+        {
+            return;
+        }
+
+        auto empty = m_empty.row(y);
+        auto emptyBelow = m_empty.row(y + 1);
+        auto roundedBelow = m_rounded.row(y + 1);
+        auto crushableBelow = m_crushable.row(y + 1);
+
+        if (!emptyBelow)
+        {
+            // Nothing happens on the bottom row
+            std::fill(crush, crush + words, 0);
+            std::fill(slideLeft, slideLeft + words, 0);
+            std::fill(slideRight, slideRight + words, 0);
+            std::fill(fall, fall + words, 0);
+            return;
+        }
+
+        for (size_t w = 0; w < words; w++)
+        {
+            // Off something rounded if free to the side and down
+            auto left = Bitboard::fromLeft(empty, w) & Bitboard::fromLeft(emptyBelow, w);
+            auto right = Bitboard::fromRight(empty, w, words) & Bitboard::fromRight(emptyBelow, w, words);
+
+            crush[w] = crushableBelow[w];
+            slideLeft[w] = roundedBelow[w] & left;
+            slideRight[w] = roundedBelow[w] & ~left & right;
+            fall[w] = emptyBelow[w];
+        }
+    }
+
+    std::shared_ptr<ILevel> m_level;
+    std::shared_ptr<IEntityStore> m_store;
+
+    // What the rules look at
+    Bitboard m_empty;     // EMPTY tile, no entity
+    Bitboard m_rounded;   // Things fall off these
+    Bitboard m_crushable; // Destroyed when something falls on them
+
+    // The intents, for the prepared rows
+    Bitboard m_crush;
+    Bitboard m_slideLeft;
+    Bitboard m_slideRight;
+    Bitboard m_fall;
+
+    std::unique_ptr<ObserverCookie> m_tileCookie;
+    std::unique_ptr<ObserverCookie> m_occupancyCookie;
+};
@@ -17,74 +17,82 @@ public:
     {
     }
 
-    bool run(unsigned ms) override
+    enum class Intent
     {
-        auto isEmpty = [this](const point &pt)
-        {
-            auto tile = m_level->tileAt(pt);
-            if (tile)
-            {
-                auto entityAt = IEntityStore::getInstance()->getEntityByPoint(pt);
+        STAY,
+        CRUSH,       // Fall on what's below and explode
+        FALL,
+        SLIDE_LEFT,  // Off what's below
+        SLIDE_RIGHT,
+    };
 
-                if (entityAt)
-                {
-                    return false;
-                }
+    bool run(unsigned ms) override
+    {
+        return apply(plan(*IEntityStore::getInstance()));
+    }
 
-                return *tile == TileType::EMPTY;
-            }
+    /**
+     * Decide what to do without changing anything, from the 3x3 neighborhood
+     * fetched in one go.
+     * Only reads, so it can run on a worker thread.
+     */
+    Intent plan(IEntityStore &store) const
+    {
+        Neighborhood<1> around;
+        auto cur = m_entity->getPosition();
 
-            return false;
-        };
+        m_level->getNeighborhood(cur, around);
+        store.getNeighborhood(cur, around);
 
-        auto entityShouldBeDestroyed = [](const std::shared_ptr<IEntity> ent)
+        auto isEmpty = [&around](int dx, int dy)
         {
-            if (!ent)
-            {
-                return false;
-            }
+            auto tile = around.tileAt(dx, dy);
 
-            switch (ent->getType())
-            {
-            case EntityType::PLAYER:
-            case EntityType::GHOST:
-            case EntityType::BOMB:
-                return true;
-            default:
-                break;
-            }
+            return tile && !around.hasEntity(dx, dy) && tileHas(*tile, TILE_OPEN);
+        };
 
-            return false;
+        auto entityBelowHas = [&around](uint8_t attribute)
+        {
+            return around.hasEntity(0, 1) && entityHas(around.entityAt(0, 1), attribute);
         };
 
-        auto shouldFallOnEntityBelow = [](const std::shared_ptr<IEntity> ent)
+        // Falling on an entity?
+        if (isFalling() && entityBelowHas(ENTITY_CRUSHABLE))
+        {
+            return Intent::CRUSH;
+        }
+        // Standing on an entity
+        else if (entityBelowHas(ENTITY_ROUNDED))
         {
-            if (!ent)
+            // Fall if it's free to the side and down
+            if (isEmpty(-1, 0) && isEmpty(-1, 1))
             {
-                return false;
+                return Intent::SLIDE_LEFT;
             }
-
-            switch (ent->getType())
+            else if (isEmpty(1, 0) && isEmpty(1, 1))
             {
-            case EntityType::BOMB:
-            case EntityType::BOULDER:
-            case EntityType::DIAMOND:
-                return true;
-            default:
-                break;
+                return Intent::SLIDE_RIGHT;
             }
+        }
+        else if (isEmpty(0, 1))
+        {
+            return Intent::FALL;
+        }
 
-            return false;
-        };
+        return Intent::STAY;
+    }
 
+    /// Carry out what plan() decided, with nothing changed nearby since
+    bool apply(Intent intent)
+    {
         auto cur = m_entity->getPosition();
-        auto below = cur + Direction::DOWN;
-
-        auto entityBelow = IEntityStore::getInstance()->getEntityByPoint(cur + Direction::DOWN);
 
-        // Falling on an entity?
-        if (isFalling() && entityShouldBeDestroyed(entityBelow))
+        switch (intent)
         {
+        case Intent::CRUSH:
+        {
+            auto entityBelow = IEntityStore::getInstance()->getEntityByPoint(cur + Direction::DOWN);
+
             m_entity->remove();
             entityBelow->remove();
 
@@ -92,42 +100,28 @@ public:
 
             return true;
         }
-        // Standing on an entity
-        else if (shouldFallOnEntityBelow(entityBelow))
-        {
-            // Fall if it's free to the side and down
-            auto left = cur + Direction::LEFT;
-            auto downLeft = (cur + Direction::LEFT) + Direction::DOWN;
-            auto right = cur + Direction::RIGHT;
-            auto downRight = (cur + Direction::RIGHT) + Direction::DOWN;
-
-            if (isEmpty(left) && isEmpty(downLeft))
-            {
-                m_entity->setPosition(cur + Direction::LEFT);
-                return fall();
-            }
-            else if (isEmpty(right) && isEmpty(downRight))
-            {
-                m_entity->setPosition(cur + Direction::RIGHT);
-                return fall();
-            }
-        }
-        else if (!entityBelow && isEmpty(below))
-        {
+        case Intent::FALL:
             m_entity->setPosition(cur + Direction::DOWN);
-
             return fall();
+        case Intent::SLIDE_LEFT:
+            m_entity->setPosition(cur + Direction::LEFT);
+            return fall();
+        case Intent::SLIDE_RIGHT:
+            m_entity->setPosition(cur + Direction::RIGHT);
+            return fall();
+        default:
+            break;
         }
 
         return dontFall();
     }
 
-private:
     bool isFalling() const
     {
         return m_falling;
     }
 
+private:
     bool fall()
     {
         m_falling = true;
@@ -7,22 +7,136 @@
 
 #include <memory>
 #include <vector>
+#include <array>
 #include <assert.h>
 
+/**
+ * Where the ghosts of a level have been, shared by all of them. Each cell
+ * remembers when a ghost last stepped there, so the least recently visited
+ * neighbour is the most novel one. Walkability is kept up to date from tile
+ * changes, so a ghost step only looks at its four neighbours.
+ */
+class ExplorationField
+{
+public:
+    ExplorationField(std::shared_ptr<ILevel> level) :
+        m_level(level),
+        m_size(level->getSize()),
+        m_walkable(m_size.width * m_size.height),
+        m_lastVisit(m_size.width * m_size.height)
+    {
+        for (int y = 0; y < (int)m_size.height; y++)
+        {
+            for (int x = 0; x < (int)m_size.width; x++)
+            {
+                updateTile(*level, {x, y});
+            }
+        }
+
+        m_cookie = level->onTileChange([this](const point &where)
+        {
+            if (auto level = m_level.lock())
+            {
+                updateTile(*level, where);
+            }
+        });
+    }
+
+    // The field of the current level, shared by its ghosts
+    static std::shared_ptr<ExplorationField> forLevel(std::shared_ptr<ILevel> level)
+    {
+        static std::weak_ptr<ExplorationField> g_instance;
+
+        if (auto p = g_instance.lock())
+        {
+            if (p->m_level.lock() == level)
+            {
+                return p;
+            }
+        }
+
+        auto p = std::make_shared<ExplorationField>(level);
+        g_instance = p;
+
+        return p;
+    }
+
+    bool isWalkable(const point &where) const
+    {
+        return inside(where) && m_walkable[index(where)];
+    }
+
+    // 0 for never visited
+    uint32_t lastVisit(const point &where) const
+    {
+        return m_lastVisit[index(where)];
+    }
+
+    void visit(const point &where)
+    {
+        if (inside(where))
+        {
+            m_lastVisit[index(where)] = ++m_clock;
+        }
+    }
+
+private:
+    bool inside(const point &where) const
+    {
+        return where.x >= 0 && where.y >= 0 && where.x < (int)m_size.width && where.y < (int)m_size.height;
+    }
+
+    size_t index(const point &where) const
+    {
+        return where.y * m_size.width + where.x;
+    }
+
+    void updateTile(const ILevel &level, const point &where)
+    {
+        if (!inside(where))
+        {
+            return;
+        }
+
+        auto tile = level.tileAt(where);
+
+        // Ghosts can only walk to some positions
+        m_walkable[index(where)] = tile && tileHas(*tile, TILE_WALKABLE);
+    }
+
+    std::weak_ptr<ILevel> m_level;
+    extents m_size;
+    std::vector<bool> m_walkable;
+    std::vector<uint32_t> m_lastVisit;
+    uint32_t m_clock{0};
+    std::unique_ptr<ObserverCookie> m_cookie;
+};
+
 class GhostWalkingTrait : public ITrait
 {
 public:
     GhostWalkingTrait(std::shared_ptr<ILevel> level, std::shared_ptr<IEntity> entity) :
         m_level(level),
-        m_entity(entity)
+        m_entity(entity),
+        m_field(ExplorationField::forLevel(level))
     {
+        m_field->visit(entity->getPosition());
     }
 
     bool run(unsigned ms) override
     {
-        auto walkable = [this](std::vector<point> &dst, const point &where)
+        auto store = IEntityStore::getInstance();
+        auto pos = m_entity->getPosition();
+
+        // The least recently visited neighbours
+        std::array<point, 4> candidates;
+        unsigned count = 0;
+        uint32_t oldest = 0xffffffff;
+
+        for (auto dir : {Direction::UP, Direction::DOWN, Direction::LEFT, Direction::RIGHT})
         {
-            auto ent = IEntityStore::getInstance()->getEntityByPoint(where);
+            auto where = pos + dir;
+            auto ent = store->getEntityByPoint(where);
 
             if (ent)
             {
@@ -33,125 +147,42 @@ public:
                 }
 
                 // Not a possible point
-                return;
-            }
-
-            auto tile = m_level->tileAt(where);
-            if (tile)
-            {
-                // Ghosts can only walk to some positions
-                if (*tile == TileType::EMPTY ||
-                    *tile == TileType::TELEPORTER)
-                {
-                    dst.push_back(where);
-                }
+                continue;
             }
-        };
-
-        auto lookup = [this](const point &where)
-        {
-           return std::find_if(m_visitedPositions.begin(), m_visitedPositions.end(),
-                [where](const visit &cur)
-                {
-                    return cur.where == where;
-                });
-        };
 
-        auto intersection = [this, lookup](const std::vector<point> &positions)
-        {
-            std::vector<point> out;
-
-            for (auto &it : positions)
+            if (!m_field->isWalkable(where))
             {
-                auto cur = lookup(it);
-                if (cur == m_visitedPositions.end())
-                {
-                    out.push_back(it);
-                }
+                continue;
             }
 
-            return out;
-        };
-
-        auto select = [this, lookup, intersection](const std::vector<point> &positions)
-        {
-            auto unique = intersection(positions);
-
-            if (!unique.empty())
+            auto last = m_field->lastVisit(where);
+            if (last < oldest)
             {
-                auto &which = unique[random() % unique.size()];
-
-                // Unvisited position
-                if (m_visitedPositions.size() >= m_visitLimit)
-                {
-                    m_visitedPositions.pop_back();
-                }
-                m_visitedPositions.push_back({which, 1});
-
-                return which;
+                oldest = last;
+                count = 0;
             }
-
-            // All has been visited before
-            unsigned smallest = 0xffffffff;
-            auto which = positions[0];
-
-            auto selected = m_visitedPositions.end();
-            for (auto &cur : positions)
+            if (last == oldest)
             {
-                auto it = lookup(cur);
-                assert(it != m_visitedPositions.end());
-
-                if (it->count < smallest)
-                {
-                    which = it->where;
-                    selected = it;
-                    smallest = it->count;
-                }
+                candidates[count++] = where;
             }
-            assert(selected != m_visitedPositions.end());
-            selected->count++;
-
-            // Order by count
-            std::sort(m_visitedPositions.begin(), m_visitedPositions.end(),
-                [](const visit &one, const visit &other)
-                {
-                     return one.count >= other.count;
-                });
-
-            return which;
-        };
-
-        auto pos = m_entity->getPosition();
-        std::vector<point> examine;
-
-        walkable(examine, pos + Direction::UP);
-        walkable(examine, pos + Direction::DOWN);
-        walkable(examine, pos + Direction::LEFT);
-        walkable(examine, pos + Direction::RIGHT);
+        }
 
-        if (examine.size() == 0)
+        if (count == 0)
         {
             // I'm stuck!
             return false;
         }
 
-        auto where = select(examine);
+        auto where = count == 1 ? candidates[0] : candidates[random() % count];
+
+        m_field->visit(where);
         m_entity->setPosition(where);
 
         return false;
     }
 
 private:
-    struct visit
-    {
-        point    where;
-        uint32_t count {0};
-    };
-
-    std::vector<visit> m_visitedPositions;
-
-    const uint32_t m_visitLimit{20}; // The maximum number of positions to remember
-    Direction m_dir{Direction::UP};
     std::shared_ptr<ILevel> m_level;
     std::shared_ptr<IEntity> m_entity;
+    std::shared_ptr<ExplorationField> m_field;
 };
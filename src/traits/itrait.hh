@@ -1,6 +1,8 @@
 #pragma once
 
-class ITrait
+#include <pool.hh>
+
+class ITrait : public PoolAllocated
 {
 public:
     virtual ~ITrait()
@@ -50,7 +50,7 @@ public:
         {
             return false;
         }
-        if (*tileAtDst == TileType::DIRT)
+        if (tileHas(*tileAtDst, TILE_DIGGABLE))
         {
             m_level->setTile(dst, TileType::EMPTY);
         }
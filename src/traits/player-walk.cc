@@ -35,12 +35,18 @@ public:
         auto store = IEntityStore::getInstance();
 
         auto dir = keysToDir(keys);
-        auto dst = m_entity->getPosition() + dir;
+        auto cur = m_entity->getPosition();
+        auto step = point{} + dir;
+        auto dst = cur + step;
 
         m_entity->setDirection(dir);
 
-        auto tileAtDst = m_level->tileAt(dst);
-        auto entAtDst = store->getEntityByPoint(dst);
+        // Everything a step or a push away
+        Neighborhood<2> around;
+        m_level->getNeighborhood(cur, around);
+        store->getNeighborhood(cur, around);
+
+        auto tileAtDst = around.tileAt(step.x, step.y);
 
         if (!tileAtDst)
         {
@@ -53,9 +59,10 @@ public:
             return false;
         }
 
-        if (entAtDst)
+        if (around.hasEntity(step.x, step.y))
         {
-            auto type = entAtDst->getType();
+            auto type = around.entityAt(step.x, step.y);
+            auto entAtDst = store->getEntityById(around.at(step.x, step.y).id);
 
             if (type == EntityType::DIAMOND)
             {
@@ -63,7 +70,7 @@ public:
                 entAtDst->remove();
                 m_props->set("diamonds", m_props->asInt("diamonds") + 1);
             }
-            else if (type == EntityType::BOULDER)
+            else if (entityHas(type, ENTITY_PUSHABLE))
             {
                 if (dir == Direction::UP || dir == Direction::DOWN)
                 {
@@ -71,21 +78,18 @@ public:
                     return false;
                 }
 
-                auto afterBoulder = dst + dir;
-                auto tileAfterBoulder = m_level->tileAt(afterBoulder);
+                auto tileAfterBoulder = around.tileAt(2 * step.x, 2 * step.y);
 
                 if (!tileAfterBoulder)
                 {
                     // Out of bounds
                     return false;
                 }
-                auto entityAfterBoulder = store->getEntityByPoint(afterBoulder);
 
-                if ((*tileAfterBoulder == TileType::EMPTY || *tileAfterBoulder == TileType::TELEPORTER)
-                    && !entityAfterBoulder)
+                if (tileHas(*tileAfterBoulder, TILE_WALKABLE) && !around.hasEntity(2 * step.x, 2 * step.y))
                 {
                     // push!
-                    entAtDst->setPosition(afterBoulder);
+                    entAtDst->setPosition(dst + dir);
                 }
                 else
                 {
@@ -95,7 +99,7 @@ public:
         }
 
         // Move the player
-        if (*tileAtDst == TileType::DIRT)
+        if (tileHas(*tileAtDst, TILE_DIGGABLE))
         {
             m_level->setTile(dst, TileType::EMPTY);
         }
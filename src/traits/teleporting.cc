@@ -14,33 +14,36 @@ public:
     TeleporterTrait(std::shared_ptr<ILevel> level, int delay) :
         m_level(level),
         m_delay(delay),
-        m_timeout(delay)
+        m_timeout(delay),
+        m_isTeleporter(level->getSize().width * level->getSize().height)
     {
         locateTeleporters();
+
+        // Only look for entities on the teleporters when something has changed there
+        m_cookie = IEntityStore::getInstance()->onOccupancyChange([this](const point &where)
+        {
+            if (isTeleporter(where))
+            {
+                m_occupancyChanged = true;
+            }
+        });
     }
 
     bool run(unsigned ms) override
     {
-        auto store = IEntityStore::getInstance();
-
-        std::shared_ptr<IEntity> toTeleport;
-
-        for (auto &where : m_teleporterLocations)
+        if (m_occupancyChanged)
         {
-            auto ent = store->getEntityByPoint(where);
-
-            if (ent)
-            {
-                toTeleport = ent;
-                break;
-            }
+            m_occupied = findEntityToTeleport() != nullptr;
+            m_occupancyChanged = false;
         }
 
-        if (toTeleport)
+        if (m_occupied)
         {
             m_timeout -= ms;
             if (m_timeout <= 0)
             {
+                auto store = IEntityStore::getInstance();
+                auto toTeleport = findEntityToTeleport();
                 point dst;
 
                 do
@@ -60,6 +63,7 @@ public:
                     }
 
                     m_teleporterLocations.clear();
+                    m_occupied = false;
                 }
                 else
                 {
@@ -77,6 +81,35 @@ public:
     }
 
 private:
+    std::shared_ptr<IEntity> findEntityToTeleport() const
+    {
+        auto store = IEntityStore::getInstance();
+
+        for (auto &where : m_teleporterLocations)
+        {
+            auto ent = store->getEntityByPoint(where);
+
+            if (ent)
+            {
+                return ent;
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool isTeleporter(const point &where) const
+    {
+        auto &size = m_level->getSize();
+
+        if (where.x < 0 || where.y < 0 || where.x >= (int)size.width || where.y >= (int)size.height)
+        {
+            return false;
+        }
+
+        return m_isTeleporter[where.y * size.width + where.x];
+    }
+
     void locateTeleporters()
     {
         for (int y = 0; y < m_level->getSize().height; y++)
@@ -88,6 +121,7 @@ private:
                 if (tile && *tile == TileType::TELEPORTER)
                 {
                     m_teleporterLocations.push_back({x,y});
+                    m_isTeleporter[y * m_level->getSize().width + x] = true;
                 }
             }
         }
@@ -98,5 +132,10 @@ private:
     int m_timeout;
 
     std::vector<point> m_teleporterLocations;
+    std::vector<bool> m_isTeleporter;
+
+    bool m_occupancyChanged{true};
+    bool m_occupied{false};
+    std::unique_ptr<ObserverCookie> m_cookie;
 };
     
\ No newline at end of file
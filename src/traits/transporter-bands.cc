@@ -42,20 +42,16 @@ private:
         {
             auto store = IEntityStore::getInstance();
 
+            // The row above the band
             point start = {m_start.x, m_start.y - 1};
-            point end = {m_end.x, m_end.y - 1};
+            extents size = {(unsigned)(m_end.x - m_start.x), 1};
 
             std::vector<std::shared_ptr<IEntity>> toMove;
 
-            for (auto cur = start; cur != end; cur = cur + Direction::RIGHT)
+            store->queryRect(start, size, [&toMove](const std::shared_ptr<IEntity> &ent)
             {
-                auto ent = store->getEntityByPoint(cur);
-
-                if (ent)
-                {
-                    toMove.push_back(ent);
-                }
-            }
+                toMove.push_back(ent);
+            });
 
             for (auto &ent : toMove)
             {
@@ -66,7 +62,7 @@ private:
                 {
                     continue;
                 }
-                if (*dstTile != TileType::EMPTY)
+                if (!tileHas(*dstTile, TILE_OPEN))
                 {
                     // Can't transport through walls etc
                     continue;
@@ -0,0 +1,152 @@
+#include <worker-pool.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool : public IWorkerPool
+{
+public:
+    WorkerPool(unsigned threads) :
+        m_threadCount(std::max(threads, 1U))
+    {
+        for (unsigned i = 1; i < m_threadCount; i++)
+        {
+            m_workers.emplace_back([this]()
+            {
+                work();
+            });
+        }
+    }
+
+    ~WorkerPool() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_quit = true;
+        }
+        m_wakeup.notify_all();
+
+        for (auto &cur : m_workers)
+        {
+            cur.join();
+        }
+    }
+
+    unsigned getThreadCount() const override
+    {
+        return m_threadCount;
+    }
+
+    void forEachStripe(size_t count, const std::function<void(size_t first, size_t last)> &job) override
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        if (m_workers.empty())
+        {
+            job(0, count);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_job = &job;
+            m_count = count;
+            m_nextStripe = 0;
+            m_stripesLeft = m_threadCount;
+            m_generation++;
+        }
+        m_wakeup.notify_all();
+
+        // Help out, and then wait for the stragglers
+        runStripes();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]()
+        {
+            return m_stripesLeft == 0;
+        });
+        m_job = nullptr;
+    }
+
+private:
+    void work()
+    {
+        uint64_t seen = 0;
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+
+                m_wakeup.wait(lock, [this, seen]()
+                {
+                    return m_quit || m_generation != seen;
+                });
+                if (m_quit)
+                {
+                    return;
+                }
+                seen = m_generation;
+            }
+
+            runStripes();
+        }
+    }
+
+    void runStripes()
+    {
+        while (true)
+        {
+            auto stripe = m_nextStripe.fetch_add(1);
+
+            if (stripe >= m_threadCount)
+            {
+                return;
+            }
+
+            auto first = m_count * stripe / m_threadCount;
+            auto last = m_count * (stripe + 1) / m_threadCount;
+
+            if (first != last)
+            {
+                (*m_job)(first, last);
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_stripesLeft == 0)
+            {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    const unsigned m_threadCount;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_done;
+    bool m_quit{false};
+    uint64_t m_generation{0};
+
+    // The current job, set up under the mutex before waking the workers
+    const std::function<void(size_t first, size_t last)> *m_job{nullptr};
+    size_t m_count{0};
+    std::atomic<unsigned> m_nextStripe{0};
+    unsigned m_stripesLeft{0};
+};
+
+std::unique_ptr<IWorkerPool> IWorkerPool::create(unsigned threads)
+{
+    return std::make_unique<WorkerPool>(threads);
+}
@@ -5,6 +5,11 @@
 #include <entity.hh>
 #include <behavior.hh>
 
+#include <algorithm>
+#include <string>
+#include <tuple>
+#include <vector>
+
 // In ms
 static const unsigned FALL_TIME = 100;
 static const unsigned BOMB_TIMEOUT = 2000;
@@ -324,6 +329,93 @@ SCENARIO("fireballs fall and disappears")
     }
 }
 
+SCENARIO("Behaviors of entities get all the traits of their type")
+{
+    auto store = IEntityStore::getInstance();
+
+    std::shared_ptr<ILevel> lvl = ILevel::fromString("3 3 "
+            "b.f"
+            " . "
+            "..p"
+    );
+    REQUIRE(lvl);
+
+    WHEN("a bomb gets its behavior")
+    {
+        auto bomb = store->getEntityByPoint({0,0});
+        REQUIRE(bomb);
+
+        auto behavior = IBehavior::fromEntity(lvl, bomb);
+        behavior->run(FALL_TIME);
+
+        THEN("it both falls and explodes")
+        {
+            REQUIRE(bomb->getPosition() == (point){0,1});
+
+            behavior->run(BOMB_TIMEOUT);
+            REQUIRE(!store->getEntityById(bomb->getId()));
+            REQUIRE(store->getEntityByPoint({0,1})->getType() == EntityType::FIREBALL);
+        }
+    }
+
+    WHEN("a fireball gets its behavior")
+    {
+        auto fireball = store->getEntityByPoint({2,0});
+        REQUIRE(fireball);
+
+        auto behavior = IBehavior::fromEntity(lvl, fireball);
+        behavior->run(FALL_TIME);
+
+        THEN("it both falls and burns out")
+        {
+            REQUIRE(fireball->getPosition() == (point){2,1});
+
+            behavior->run(FIREBALL_BURNOUT_TIME);
+            REQUIRE(!store->getEntityById(fireball->getId()));
+        }
+    }
+}
+
+SCENARIO("Collisions are resolved by the entity types")
+{
+    auto store = IEntityStore::getInstance();
+
+    std::shared_ptr<ILevel> lvl = ILevel::fromString("3 2 "
+                                  "o.g"
+                                  "..p");
+    REQUIRE(lvl);
+
+    auto boulder = store->getEntityByPoint({0, 0});
+    auto ghost = store->getEntityByPoint({2, 0});
+    REQUIRE(boulder);
+    REQUIRE(ghost);
+
+    auto behavior = IBehavior::fromLevel(lvl);
+
+    WHEN("a fireball appears on an entity")
+    {
+        auto spawned = store->spawnBatch({{EntityType::FIREBALL, {0, 0}}});
+
+        THEN("the entity burns up")
+        {
+            REQUIRE(spawned.size() == 1U);
+            REQUIRE(!store->getEntityById(boulder->getId()));
+            REQUIRE(store->getEntityByPoint({0, 0}) == spawned[0]);
+        }
+    }
+
+    WHEN("entities without a rule for them meet")
+    {
+        ghost->setPosition({0, 0});
+
+        THEN("nothing happens")
+        {
+            REQUIRE(store->getEntityById(boulder->getId()));
+            REQUIRE(store->getEntityById(ghost->getId()));
+        }
+    }
+}
+
 SCENARIO("Ghosts appear!")
 {
     auto store = IEntityStore::getInstance();
@@ -389,6 +481,35 @@ SCENARIO("Ghosts appear!")
         }
     }
 
+    WHEN("several ghosts explore the same level")
+    {
+        std::shared_ptr<ILevel> lvl = ILevel::fromString("7 3 "
+                                      "......."
+                                      "g  g  ." // 0, 1 and 3, 1
+                                      "......p");
+        REQUIRE(lvl);
+
+        auto first = store->getEntityByPoint({0, 1});
+        auto second = store->getEntityByPoint({3, 1});
+        REQUIRE(first);
+        REQUIRE(second);
+        auto firstBehavior = IBehavior::fromEntity(lvl, first);
+        auto secondBehavior = IBehavior::fromEntity(lvl, second);
+
+        THEN("they avoid the places where the others have been")
+        {
+            // To the end of the corridor, and back again
+            for (auto i = 0; i < 3; i++)
+            {
+                firstBehavior->run(GHOST_MOVEMENT_TIME);
+            }
+            REQUIRE(first->getPosition() == (point){1, 1});
+
+            secondBehavior->run(GHOST_MOVEMENT_TIME);
+            REQUIRE(second->getPosition() == (point){4, 1});
+        }
+    }
+
     WHEN("a ghost can select between paths")
     {
         THEN("it will normally prefer continuing in the same direction as before")
@@ -555,3 +676,182 @@ SCENARIO("teleporters transport entities between different points")
         }
     }
 }
+
+SCENARIO("Entity behaviors run in scan order")
+{
+    auto store = IEntityStore::getInstance();
+
+    std::shared_ptr<ILevel> lvl = ILevel::fromString("2 5 "
+            "o."
+            "o."
+            "  "
+            "  "
+            ".p"
+            );
+    REQUIRE(lvl);
+
+    auto top = store->getEntityByPoint({0,0});
+    auto bottom = store->getEntityByPoint({0,1});
+    REQUIRE(top);
+    REQUIRE(bottom);
+
+    auto behaviors = IEntityBehaviors::create(lvl);
+
+    // The top one first, so insertion order doesn't decide
+    behaviors->addEntity(top);
+    behaviors->addEntity(bottom);
+
+    WHEN("a stack of boulders has empty space below")
+    {
+        behaviors->run(FALL_TIME);
+
+        THEN("the lowest falls first, so the whole stack falls together")
+        {
+            REQUIRE(bottom->getPosition() == (point){0,2});
+            REQUIRE(top->getPosition() == (point){0,1});
+        }
+    }
+
+    WHEN("a resting boulder has been idle for a while")
+    {
+        std::shared_ptr<ILevel> dirtLvl = ILevel::fromString("3 3 "
+                ".o."
+                "..."
+                "..p"
+                );
+        REQUIRE(dirtLvl);
+
+        auto boulder = store->getEntityByPoint({1,0});
+        REQUIRE(boulder);
+
+        auto resting = IEntityBehaviors::create(dirtLvl);
+        resting->addEntity(boulder);
+
+        for (auto i = 0; i < 5; i++)
+        {
+            resting->run(FALL_TIME);
+        }
+        REQUIRE(boulder->getPosition() == (point){1,0});
+
+        AND_WHEN("the dirt below it is dug away")
+        {
+            dirtLvl->setTile({1,1}, TileType::EMPTY);
+            resting->run(FALL_TIME);
+
+            THEN("it wakes up and falls")
+            {
+                REQUIRE(boulder->getPosition() == (point){1,1});
+            }
+        }
+
+        AND_WHEN("the dirt further away is dug away")
+        {
+            dirtLvl->setTile({0,2}, TileType::EMPTY);
+            resting->run(FALL_TIME);
+
+            THEN("it stays")
+            {
+                REQUIRE(boulder->getPosition() == (point){1,0});
+            }
+        }
+    }
+
+    WHEN("an entity is removed from the behaviors")
+    {
+        behaviors->removeEntity(bottom->getId());
+        behaviors->run(FALL_TIME);
+
+        THEN("its traits no longer run")
+        {
+            REQUIRE(bottom->getPosition() == (point){0,1});
+            REQUIRE(top->getPosition() == (point){0,0});
+        }
+    }
+}
+
+// Where everything ends up after some ticks of a level full of falling objects
+static std::vector<std::tuple<int, int, int>> simulateFalling(unsigned threads, bool planning = true)
+{
+    auto store = IEntityStore::getInstance();
+
+    const unsigned width = 120;
+    const unsigned height = 60;
+    std::string data = std::to_string(width) + " " + std::to_string(height) + " ";
+    uint32_t seed = 1;
+
+    for (unsigned i = 0; i < width * height; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+
+        const char *chars = "ooood b   ...";
+        data += chars[(seed >> 16) % 13];
+    }
+    data.back() = 'p';
+
+    std::shared_ptr<ILevel> lvl = ILevel::fromString(data);
+    REQUIRE(lvl);
+
+    auto behaviors = IEntityBehaviors::create(lvl, threads);
+    behaviors->setBulkPlanning(planning);
+    for (auto &cur : store->getEntities())
+    {
+        if (cur->getType() != EntityType::PLAYER)
+        {
+            behaviors->addEntity(cur);
+        }
+    }
+    auto cookie = store->onDestruction([&behaviors](const std::vector<uint32_t> &ids)
+    {
+        for (auto id : ids)
+        {
+            behaviors->removeEntity(id);
+        }
+    });
+
+    for (auto i = 0; i < 30; i++)
+    {
+        behaviors->run(FALL_TIME);
+        store->destroyRemoved();
+    }
+
+    std::vector<std::tuple<int, int, int>> out;
+    store->forEachEntity([&out](const std::shared_ptr<IEntity> &entity)
+    {
+        auto where = entity->getPosition();
+
+        out.emplace_back(where.y, where.x, (int)entity->getType());
+    });
+    std::sort(out.begin(), out.end());
+
+    return out;
+}
+
+SCENARIO("Entity behaviors can be planned in bulk")
+{
+    WHEN("a large level is simulated with and without planning")
+    {
+        auto unplanned = simulateFalling(1, false);
+        auto planned = simulateFalling(1);
+
+        THEN("the outcome is the same")
+        {
+            REQUIRE(unplanned.size() > 2000);
+            REQUIRE(unplanned == planned);
+        }
+    }
+}
+
+SCENARIO("Entity behaviors can use worker threads")
+{
+    WHEN("a large level is simulated with and without threads")
+    {
+        auto single = simulateFalling(1);
+        auto threaded = simulateFalling(4);
+
+        THEN("the outcome is the same")
+        {
+            REQUIRE(single.size() > 2000);
+            REQUIRE(single == threaded);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#include <catch.hpp>
+#include <trompeloeil.hpp>
+
+#include <bitboard.hh>
+
+SCENARIO("Bitboards hold one bit per cell")
+{
+    Bitboard board({130, 3});
+    REQUIRE(board.getWordsPerRow() == 3);
+
+    WHEN("bits are set")
+    {
+        board.set({0, 0}, true);
+        board.set({63, 1}, true);
+        board.set({64, 1}, true);
+        board.set({129, 2}, true);
+
+        // Outside, and ignored
+        board.set({130, 2}, true);
+        board.set({-1, 0}, true);
+
+        THEN("they can be tested, and nothing else is set")
+        {
+            REQUIRE(board.test({0, 0}));
+            REQUIRE(board.test({63, 1}));
+            REQUIRE(board.test({64, 1}));
+            REQUIRE(board.test({129, 2}));
+
+            REQUIRE(!board.test({1, 0}));
+            REQUIRE(!board.test({130, 2}));
+            REQUIRE(!board.test({-1, 0}));
+            REQUIRE(board.row(2)[2] == 1ULL << 1);
+        }
+
+        AND_WHEN("a bit is cleared")
+        {
+            board.set({63, 1}, false);
+
+            THEN("only that bit is affected")
+            {
+                REQUIRE(!board.test({63, 1}));
+                REQUIRE(board.test({64, 1}));
+            }
+        }
+    }
+
+    WHEN("a row is shifted to look at the neighbours")
+    {
+        board.set({63, 1}, true);
+        board.set({64, 1}, true);
+
+        auto row = board.row(1);
+        auto words = board.getWordsPerRow();
+
+        THEN("the bits move across word boundaries")
+        {
+            // Cell 64 is left of 65, and cell 63 left of 64
+            REQUIRE(Bitboard::fromLeft(row, 0) == 0);
+            REQUIRE(Bitboard::fromLeft(row, 1) == 0x3ULL);
+
+            // Cell 63 is right of 62, and cell 64 right of 63
+            REQUIRE(Bitboard::fromRight(row, 0, words) == 0xc000000000000000ULL);
+            REQUIRE(Bitboard::fromRight(row, 1, words) == 0);
+        }
+    }
+
+    WHEN("a row outside the board is asked for")
+    {
+        THEN("there is none")
+        {
+            REQUIRE(board.row(-1) == nullptr);
+            REQUIRE(board.row(3) == nullptr);
+        }
+    }
+}
@@ -12,6 +12,9 @@ TEST_CASE("An entity can't be created from an invalid character", "[entity]")
 
 TEST_CASE("An entity can be created from a character", "[entity]")
 {
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
     WHEN("the entity is a boulder")
     {
         auto ent = IEntity::createFromChar('o', {90,1});
@@ -30,8 +33,22 @@ TEST_CASE("An entity can be created from a character", "[entity]")
     }
 }
 
+TEST_CASE("Entity types have attributes", "[entity]")
+{
+    REQUIRE(entityHas(EntityType::BOMB, ENTITY_ROUNDED | ENTITY_CRUSHABLE));
+    REQUIRE(entityHas(EntityType::BOULDER, ENTITY_PUSHABLE));
+    REQUIRE(!entityHas(EntityType::DIAMOND, ENTITY_PUSHABLE));
+    REQUIRE(!entityHas(EntityType::PLAYER, ENTITY_ROUNDED));
+    REQUIRE(!entityHas(EntityType::FIREBALL, ENTITY_CRUSHABLE));
+    REQUIRE(entityHas(EntityType::FIREBALL, ENTITY_GLOWING));
+    REQUIRE(!entityHas(EntityType::DIAMOND, ENTITY_GLOWING));
+}
+
 TEST_CASE("The position of the entity can be read and modified")
 {
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
     auto ent = IEntity::createFromChar('o', {10, 11});
     REQUIRE(ent);
 
@@ -50,7 +67,15 @@ SCENARIO("Entities can be placed and retrieved from the entity store")
     {
         THEN("entries are lost after creation")
         {
-            auto ent = IEntity::createFromChar('o', {90,1});
+            // The store is gone with its last holder, as when a level is unloaded
+            auto ent = []()
+            {
+                auto store = IEntityStore::getInstance();
+
+                store->setSize({100, 20});
+
+                return IEntity::createFromChar('o', {90,1});
+            }();
             REQUIRE(ent);
 
             REQUIRE(IEntityStore::getInstance()->getEntities().size() == 0);
@@ -60,6 +85,7 @@ SCENARIO("Entities can be placed and retrieved from the entity store")
     WHEN("the store singleton is present")
     {
         auto inst = IEntityStore::getInstance();
+        inst->setSize({100, 20});
 
         THEN("entries can be retrieved from the store")
         {
@@ -89,4 +115,594 @@ SCENARIO("Entities can be placed and retrieved from the entity store")
             REQUIRE(byId->getId() == e90_1->getId());
         }
     }
+
+    WHEN("the store is sized for a smaller level")
+    {
+        auto inst = IEntityStore::getInstance();
+        inst->setSize({100, 20});
+
+        auto inside = IEntity::createFromChar('o', {1,1});
+        auto outside = IEntity::createFromChar('o', {90,1});
+
+        inst->setSize({10, 10});
+
+        THEN("the entities which don't fit are removed")
+        {
+            auto all = inst->getEntities();
+            REQUIRE(all.size() == 1);
+            REQUIRE(all[0] == inside);
+            REQUIRE(inst->getEntityByPoint({1,1}) == inside);
+            REQUIRE_THROWS_AS(IEntity::createFromChar('o', {10,1}), std::out_of_range);
+        }
+    }
+}
+
+SCENARIO("The entity store tracks entity positions")
+{
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
+    auto a = IEntity::createFromChar('o', {1,1});
+    auto b = IEntity::createFromChar('d', {2,1});
+    REQUIRE(a);
+    REQUIRE(b);
+
+    WHEN("an entity moves")
+    {
+        a->setPosition({1,2});
+
+        THEN("it can be found at the new position only")
+        {
+            REQUIRE(!store->getEntityByPoint({1,1}));
+            REQUIRE(store->getEntityByPoint({1,2}) == a);
+            REQUIRE(store->getEntityByPoint({2,1}) == b);
+        }
+    }
+
+    WHEN("an entity is placed far away from the others")
+    {
+        auto c = IEntity::createFromChar('o', {300,200});
+        REQUIRE(c);
+
+        THEN("all of them can still be found")
+        {
+            REQUIRE(store->getEntityByPoint({1,1}) == a);
+            REQUIRE(store->getEntityByPoint({2,1}) == b);
+            REQUIRE(store->getEntityByPoint({300,200}) == c);
+            REQUIRE(!store->getEntityByPoint({200,300}));
+        }
+    }
+
+    WHEN("an entity is removed")
+    {
+        b->remove();
+
+        THEN("its position is free")
+        {
+            REQUIRE(!store->getEntityByPoint({2,1}));
+            REQUIRE(store->getEntityByPoint({1,1}) == a);
+        }
+    }
+}
+
+SCENARIO("Entities can be fetched by neighborhood")
+{
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
+    auto a = IEntity::createFromChar('o', {1,1});
+    auto b = IEntity::createFromChar('d', {2,2});
+    REQUIRE(a);
+    REQUIRE(b);
+
+    Neighborhood<1> around;
+    store->getNeighborhood({1,1}, around);
+
+    THEN("the entities around the center are reported with their types and ids")
+    {
+        REQUIRE(around.hasEntity(0, 0));
+        REQUIRE(around.entityAt(0, 0) == EntityType::BOULDER);
+        REQUIRE(around.at(0, 0).id == a->getId());
+
+        REQUIRE(around.hasEntity(1, 1));
+        REQUIRE(around.entityAt(1, 1) == EntityType::DIAMOND);
+        REQUIRE(around.at(1, 1).id == b->getId());
+
+        REQUIRE(!around.hasEntity(-1, -1));
+        REQUIRE(around.at(-1, -1).id == 0);
+        REQUIRE(!around.hasEntity(1, 0));
+    }
+
+    WHEN("an entity is removed")
+    {
+        b->remove();
+
+        Neighborhood<2> wide;
+        store->getNeighborhood({0,0}, wide);
+
+        THEN("it's no longer in the neighborhood")
+        {
+            REQUIRE(wide.hasEntity(1, 1));
+            REQUIRE(!wide.hasEntity(2, 2));
+            REQUIRE(!wide.hasEntity(-2, -2));
+        }
+    }
+}
+
+SCENARIO("Entity ids are not reused when entities are destroyed")
+{
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
+    auto ent = IEntity::createFromChar('o', {1,1});
+    REQUIRE(ent);
+    auto id = ent->getId();
+
+    WHEN("the entity is removed and dropped")
+    {
+        ent->remove();
+        ent = nullptr;
+
+        THEN("it can't be retrieved by id anymore")
+        {
+            REQUIRE(!store->getEntityById(id));
+        }
+
+        AND_THEN("new entities get other ids")
+        {
+            auto other = IEntity::createFromChar('d', {1,1});
+            REQUIRE(other);
+            REQUIRE(other->getId() != id);
+            REQUIRE(other->getType() == EntityType::DIAMOND);
+            REQUIRE(other->getPosition() == (point){1,1});
+            REQUIRE(!store->getEntityById(id));
+            REQUIRE(store->getEntityById(other->getId()) == other);
+        }
+    }
+
+    WHEN("the entity is removed but still referenced")
+    {
+        ent->remove();
+
+        THEN("it keeps its state, but is gone from the store")
+        {
+            REQUIRE(ent->getPosition() == (point){1,1});
+            REQUIRE(!store->getEntityById(id));
+            REQUIRE(!store->getEntityByPoint({1,1}));
+        }
+    }
+}
+
+SCENARIO("Entities can be visited in the entity store")
+{
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
+    auto b1 = IEntity::createFromChar('o', {1,1});
+    auto d1 = IEntity::createFromChar('d', {2,1});
+    auto b2 = IEntity::createFromChar('o', {3,1});
+    auto d2 = IEntity::createFromChar('d', {4,1});
+
+    auto countType = [store](EntityType type)
+    {
+        unsigned out = 0;
+
+        store->forEachOfType(type, [&out, type](const std::shared_ptr<IEntity> &ent)
+        {
+            REQUIRE(ent->getType() == type);
+            out++;
+        });
+
+        return out;
+    };
+
+    THEN("all entities are visited")
+    {
+        unsigned count = 0;
+        store->forEachEntity([&count](const std::shared_ptr<IEntity> &ent)
+        {
+            count++;
+        });
+        REQUIRE(count == 4);
+    }
+
+    THEN("entities can be visited by type")
+    {
+        REQUIRE(countType(EntityType::BOULDER) == 2);
+        REQUIRE(countType(EntityType::DIAMOND) == 2);
+        REQUIRE(countType(EntityType::GHOST) == 0);
+    }
+
+    WHEN("entities are removed")
+    {
+        b1->remove();
+        d2->remove();
+        d1->remove();
+
+        THEN("they are no longer visited")
+        {
+            REQUIRE(countType(EntityType::BOULDER) == 1);
+            REQUIRE(countType(EntityType::DIAMOND) == 0);
+
+            std::shared_ptr<IEntity> last;
+            store->forEachEntity([&last](const std::shared_ptr<IEntity> &ent)
+            {
+                last = ent;
+            });
+            REQUIRE(last == b2);
+        }
+    }
+}
+
+SCENARIO("Entities can be queried by area")
+{
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
+    auto a = IEntity::createFromChar('o', {1,1});
+    auto b = IEntity::createFromChar('o', {10,1});
+    auto c = IEntity::createFromChar('d', {10,10});
+    auto d = IEntity::createFromChar('d', {40,30});
+
+    auto inRect = [store](const point &topLeft, const extents &size)
+    {
+        std::vector<std::shared_ptr<IEntity>> out;
+
+        store->queryRect(topLeft, size, [&out](const std::shared_ptr<IEntity> &ent)
+        {
+            out.push_back(ent);
+        });
+
+        return out;
+    };
+
+    auto inRadius = [store](const point &center, unsigned radius)
+    {
+        std::vector<std::shared_ptr<IEntity>> out;
+
+        store->queryRadius(center, radius, [&out](const std::shared_ptr<IEntity> &ent)
+        {
+            out.push_back(ent);
+        });
+
+        return out;
+    };
+
+    THEN("rectangles return the entities within them")
+    {
+        auto all = inRect({0,0}, {100,100});
+        REQUIRE(all.size() == 4);
+
+        auto top = inRect({0,0}, {11,2});
+        REQUIRE(top.size() == 2);
+
+        auto single = inRect({10,10}, {1,1});
+        REQUIRE(single.size() == 1);
+        REQUIRE(single[0] == c);
+
+        REQUIRE(inRect({2,2}, {8,8}).empty());
+        REQUIRE(inRect({-10,-10}, {5,5}).empty());
+        REQUIRE(inRect({-10,-10}, {12,12}).size() == 1);
+    }
+
+    THEN("radius queries return the entities within the circle")
+    {
+        REQUIRE(inRadius({10,5}, 5).size() == 2);
+        REQUIRE(inRadius({10,5}, 4).size() == 1);
+        REQUIRE(inRadius({10,5}, 3).empty());
+        REQUIRE(inRadius({4,4}, 4).size() == 0);
+        REQUIRE(inRadius({4,4}, 5).size() == 1);
+    }
+
+    WHEN("entities move or are removed")
+    {
+        a->setPosition({39,30});
+        d->remove();
+
+        THEN("the queries follow")
+        {
+            REQUIRE(inRect({0,0}, {5,5}).empty());
+
+            auto moved = inRect({32,24}, {16,16});
+            REQUIRE(moved.size() == 1);
+            REQUIRE(moved[0] == a);
+        }
+    }
+}
+
+SCENARIO("Entities can be created in batches")
+{
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
+    unsigned single = 0;
+    unsigned batches = 0;
+    size_t batchSize = 0;
+
+    auto singleCookie = store->onCreation([&single](std::shared_ptr<IEntity> ent)
+    {
+        single++;
+    });
+    auto batchCookie = store->onBatchCreation([&batches, &batchSize](const std::vector<std::shared_ptr<IEntity>> &entities)
+    {
+        batches++;
+        batchSize = entities.size();
+    });
+
+    WHEN("a batch is spawned")
+    {
+        auto out = store->spawnBatch({
+            {EntityType::BOULDER, {1,1}},
+            {EntityType::DIAMOND, {2,1}},
+            {EntityType::FIREBALL, {3,1}},
+        });
+
+        THEN("all entities are created, and reported in a single event")
+        {
+            REQUIRE(out.size() == 3);
+            REQUIRE(batches == 1);
+            REQUIRE(batchSize == 3);
+            REQUIRE(single == 0);
+
+            REQUIRE(store->getEntityByPoint({2,1}) == out[1]);
+            REQUIRE(out[2]->getType() == EntityType::FIREBALL);
+        }
+    }
+
+    WHEN("a batch collides with existing entities")
+    {
+        auto existing = IEntity::createFromChar('o', {5,5});
+        REQUIRE(single == 1);
+
+        unsigned collisions = 0;
+        auto collisionCookie = store->onCollision([&collisions](std::shared_ptr<IEntity> one, std::shared_ptr<IEntity> other)
+        {
+            REQUIRE(one->getType() == EntityType::FIREBALL);
+            REQUIRE(other->getType() == EntityType::BOULDER);
+            collisions++;
+        });
+
+        auto out = store->spawnBatch({
+            {EntityType::FIREBALL, {5,5}},
+            {EntityType::FIREBALL, {6,5}},
+        });
+
+        THEN("the collisions are reported")
+        {
+            REQUIRE(out.size() == 2);
+            REQUIRE(collisions == 1);
+            REQUIRE(store->getEntityByPoint({5,5}) == out[0]);
+        }
+    }
+
+    WHEN("an empty batch is spawned")
+    {
+        auto out = store->spawnBatch({});
+
+        THEN("nothing is reported")
+        {
+            REQUIRE(out.empty());
+            REQUIRE(batches == 0);
+        }
+    }
+}
+
+SCENARIO("Removed entities are destroyed by the store")
+{
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
+    auto ent = IEntity::createFromChar('o', {3,3});
+    auto id = ent->getId();
+
+    unsigned removals = 0;
+    std::vector<uint32_t> destroyed;
+
+    auto removalCookie = ent->onRemoval([&removals](std::shared_ptr<IEntity> which)
+    {
+        removals++;
+    });
+    auto destructionCookie = store->onDestruction([&destroyed](const std::vector<uint32_t> &ids)
+    {
+        destroyed.insert(destroyed.end(), ids.begin(), ids.end());
+    });
+
+    WHEN("an entity is removed")
+    {
+        ent->remove();
+        ent->remove(); // Twice doesn't matter
+
+        THEN("it's gone from the store at once, but not yet destroyed")
+        {
+            REQUIRE(!store->getEntityByPoint({3,3}));
+            REQUIRE(!store->getEntityById(id));
+            REQUIRE(store->getEntities().empty());
+            REQUIRE(removals == 0);
+            REQUIRE(destroyed.empty());
+        }
+
+        AND_WHEN("the store destroys removed entities")
+        {
+            store->destroyRemoved();
+
+            THEN("the listeners are notified once")
+            {
+                REQUIRE(removals == 1);
+                REQUIRE(destroyed.size() == 1);
+                REQUIRE(destroyed[0] == id);
+
+                store->destroyRemoved();
+                REQUIRE(removals == 1);
+                REQUIRE(destroyed.size() == 1);
+            }
+        }
+    }
+
+    WHEN("another entity moves into the position of a removed one")
+    {
+        auto other = IEntity::createFromChar('d', {4,3});
+
+        ent->remove();
+        other->setPosition({3,3});
+        store->destroyRemoved();
+
+        THEN("the other entity stays there")
+        {
+            REQUIRE(store->getEntityByPoint({3,3}) == other);
+        }
+    }
+}
+
+SCENARIO("The store can queue movement and collision events")
+{
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
+    auto boulder = IEntity::createFromChar('o', {1,1});
+    auto fireball = IEntity::createFromChar('f', {3,1});
+
+    std::vector<MovementEvent> movements;
+    std::vector<CollisionEvent> collisions;
+    unsigned movementBatches = 0;
+    unsigned pairs = 0;
+
+    auto movementsCookie = store->onMovements([&](const std::vector<MovementEvent> &events)
+    {
+        movementBatches++;
+        movements.insert(movements.end(), events.begin(), events.end());
+    });
+    auto collisionsCookie = store->onCollisions([&collisions](const std::vector<CollisionEvent> &events)
+    {
+        collisions.insert(collisions.end(), events.begin(), events.end());
+    });
+    auto pairCookie = store->onCollision([&pairs](std::shared_ptr<IEntity> one, std::shared_ptr<IEntity> other)
+    {
+        pairs++;
+    });
+
+    WHEN("events are not queued")
+    {
+        fireball->setPosition({2,1});
+        fireball->setPosition({1,1});
+
+        THEN("collisions are reported at once, and movements not at all")
+        {
+            REQUIRE(collisions.size() == 1);
+            REQUIRE(pairs == 1);
+            REQUIRE(movementBatches == 0);
+        }
+    }
+
+    WHEN("events are queued")
+    {
+        store->setEventQueueing(true);
+
+        fireball->setPosition({2,1});
+        fireball->setPosition({1,1});
+
+        THEN("the occupancy is updated, but nothing is reported")
+        {
+            REQUIRE(store->getEntityByPoint({1,1}) == fireball);
+            REQUIRE(!store->getEntityByPoint({3,1}));
+            REQUIRE(collisions.empty());
+            REQUIRE(pairs == 0);
+            REQUIRE(movementBatches == 0);
+        }
+
+        AND_WHEN("the events are dispatched")
+        {
+            store->dispatchEvents();
+
+            THEN("they are reported in a batch per event type")
+            {
+                REQUIRE(movementBatches == 1);
+                REQUIRE(movements.size() == 2);
+                REQUIRE(movements[0].id == fireball->getId());
+                REQUIRE(movements[0].from == point{3,1});
+                REQUIRE(movements[1].to == point{1,1});
+
+                REQUIRE(collisions.size() == 1);
+                REQUIRE(collisions[0].one == fireball->getId());
+                REQUIRE(collisions[0].other == boulder->getId());
+                REQUIRE(pairs == 1);
+
+                store->dispatchEvents();
+                REQUIRE(movementBatches == 1);
+            }
+        }
+
+        AND_WHEN("an entity is removed before the events are dispatched")
+        {
+            boulder->remove();
+            store->dispatchEvents();
+
+            THEN("the batch has the collision, but it's not reported per pair")
+            {
+                REQUIRE(collisions.size() == 1);
+                REQUIRE(pairs == 0);
+            }
+        }
+
+        AND_WHEN("queueing is turned off")
+        {
+            store->setEventQueueing(false);
+
+            THEN("the queued events are dispatched")
+            {
+                REQUIRE(movementBatches == 1);
+                REQUIRE(collisions.size() == 1);
+            }
+        }
+
+        store->setEventQueueing(false);
+    }
+}
+
+SCENARIO("Occupancy changes are reported right away")
+{
+    auto store = IEntityStore::getInstance();
+    store->setSize({400, 300});
+
+    auto ent = IEntity::createFromChar('o', {1,1});
+
+    std::vector<point> changes;
+    auto cookie = store->onOccupancyChange([&changes](const point &where)
+    {
+        changes.push_back(where);
+    });
+
+    WHEN("an entity moves")
+    {
+        ent->setPosition({2,1});
+
+        THEN("both the old and the new position are reported")
+        {
+            REQUIRE(changes.size() == 2);
+            REQUIRE(changes[0] == (point){1,1});
+            REQUIRE(changes[1] == (point){2,1});
+        }
+    }
+
+    WHEN("an entity is created")
+    {
+        auto other = IEntity::createFromChar('d', {4,4});
+
+        THEN("its position is reported")
+        {
+            REQUIRE(changes.size() == 1);
+            REQUIRE(changes[0] == (point){4,4});
+        }
+    }
+
+    WHEN("an entity is removed")
+    {
+        ent->remove();
+
+        THEN("it's reported before it's destroyed")
+        {
+            REQUIRE(changes.size() == 1);
+            REQUIRE(changes[0] == (point){1,1});
+        }
+        store->destroyRemoved();
+    }
 }
@@ -92,3 +92,44 @@ SCENARIO("the game can be played")
     }
 
 }
+
+SCENARIO("the game can be played headless")
+{
+    auto game = IGame::createHeadless(10);
+
+    g_mockInput = std::make_shared<MockInput>();
+    g_mockResourceStore = std::make_shared<MockResourceStore>();
+
+    ALLOW_CALL(*g_mockResourceStore, getFrameExtents())
+        .RETURN((extents){64,64});
+    ALLOW_CALL(*g_mockResourceStore, getImageFrameCount(_))
+        .RETURN(4);
+    ALLOW_CALL(*g_mockInput, getInput())
+        .RETURN(0);
+
+    auto rv = game->setLevel("3 3 "
+        "..."
+        ".p."
+        "...");
+    REQUIRE(rv == true);
+
+    WHEN("the game is played")
+    {
+        unsigned ticks = 0;
+        auto cookie = game->onTick([&ticks](unsigned tick)
+        {
+            ticks = tick;
+        });
+
+        // No display or delays, and the game returns after the tick limit
+        rv = game->play();
+
+        THEN("the number of ticks have been played")
+        {
+            REQUIRE(ticks == 10);
+            REQUIRE(rv == true); // Still alive
+        }
+    }
+    g_mockInput = nullptr;
+    g_mockResourceStore = nullptr;
+}
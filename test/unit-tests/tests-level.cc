@@ -118,10 +118,83 @@ TEST_CASE("A level can be queried for tiles", "[level]")
     REQUIRE(t11 == TileType::EMPTY); // The player
 }
 
+TEST_CASE("A level can be queried for neighborhoods", "[level]")
+{
+    auto lvl = ILevel::fromString("3 2 ...#.p");
+    REQUIRE(lvl);
+
+    Neighborhood<1> around;
+    lvl->getNeighborhood({0, 0}, around);
+
+    // Out of bounds
+    REQUIRE(!around.tileAt(-1, -1));
+    REQUIRE(!around.tileAt(0, -1));
+    REQUIRE(!around.tileAt(-1, 1));
+
+    REQUIRE(around.tileAt(0, 0) == TileType::DIRT);
+    REQUIRE(around.tileAt(1, 0) == TileType::DIRT);
+    REQUIRE(around.tileAt(0, 1) == TileType::STONE_WALL);
+    REQUIRE(around.tileAt(1, 1) == TileType::DIRT);
+
+    // The entities are left alone
+    REQUIRE(!around.hasEntity(0, 0));
+
+    Neighborhood<2> wide;
+    lvl->getNeighborhood({1, 1}, wide);
+
+    REQUIRE(wide.tileAt(-1, 0) == TileType::STONE_WALL);
+    REQUIRE(wide.tileAt(1, 0) == TileType::EMPTY); // The player
+    REQUIRE(wide.tileAt(1, -1) == TileType::DIRT);
+    REQUIRE(!wide.tileAt(2, 0));
+    REQUIRE(!wide.tileAt(0, 1));
+}
+
+TEST_CASE("Tile changes are reported", "[level]")
+{
+    auto lvl = ILevel::fromString("3 2 ...#.p");
+    REQUIRE(lvl);
+
+    std::vector<point> changes;
+    auto cookie = lvl->onTileChange([&changes](const point &where)
+    {
+        changes.push_back(where);
+    });
+
+    lvl->setTile({1,0}, TileType::EMPTY);
+    REQUIRE(changes.size() == 1);
+    REQUIRE(changes[0] == (point){1,0});
+
+    // Not a change
+    lvl->setTile({1,0}, TileType::EMPTY);
+    REQUIRE(changes.size() == 1);
+
+    // Out of bounds
+    lvl->setTile({5,5}, TileType::EMPTY);
+    REQUIRE(changes.size() == 1);
+}
+
 TEST_CASE("A level can be queried for passable positions", "[level]")
 {
 }
 
+TEST_CASE("Tile types have attributes", "[level]")
+{
+    REQUIRE(ILevel::tileIsPassable(TileType::EMPTY));
+    REQUIRE(ILevel::tileIsPassable(TileType::DIRT));
+    REQUIRE(ILevel::tileIsPassable(TileType::TELEPORTER));
+    REQUIRE(!ILevel::tileIsPassable(TileType::STONE_WALL));
+
+    REQUIRE(tileHas(TileType::DIRT, TILE_DIGGABLE | TILE_TRANSLUCENT));
+    REQUIRE(!tileHas(TileType::DIRT, TILE_WALKABLE));
+    REQUIRE(tileHas(TileType::TELEPORTER, TILE_WALKABLE));
+    REQUIRE(!tileHas(TileType::TELEPORTER, TILE_OPEN));
+    REQUIRE(tileHas(TileType::STONE_WALL, TILE_BLAST_PROOF));
+    REQUIRE(!tileHas(TileType::WEAK_STONE_WALL, TILE_BLAST_PROOF));
+
+    // Evaluated at compile time
+    static_assert(tileHas(TileType::EMPTY, TILE_OPEN | TILE_TRANSLUCENT), "Empty is open");
+}
+
 TEST_CASE("Entities on a level are created at the correct positions", "[level]")
 {
 }
@@ -166,10 +239,15 @@ static void print_points(const std::set<point> &points, const extents &size)
     }
 }
 
-static bool points_in_x(const std::set<point> &points, const extents &size, const char *str)
+static bool points_in_x(const Illumination &lighted, const extents &size, const char *str)
 {
     unsigned cnt = 0;
 
+    std::set<point> points;
+    lighted.forEach([&points](const point &cur)
+    {
+        points.insert(cur);
+    });
     auto left = points;
 
     for (auto y = 0; y < size.height; y++)
@@ -518,6 +596,44 @@ SCENARIO("The light can show your way", "[level]")
           }
     }
 
+    WHEN("the level changes in front of the light")
+    {
+        auto lvl = ILevel::fromString("9 7 "
+                "........p"
+                "........."
+                "...###..."
+                "........."
+                "........."
+                "........."
+                ".........");
+        REQUIRE(lvl);
+
+        auto before = lvl->getIllumination({4, 4}, Direction::UP);
+        REQUIRE(before.isLit({4, 2}));
+        REQUIRE(!before.isLit({4, 1}));
+
+        // Asking again gives the same light
+        REQUIRE(lvl->getIllumination({4, 4}, Direction::UP).lit == before.lit);
+
+        lvl->setTile({4, 2}, TileType::EMPTY);
+
+        THEN("the light passes through the opening")
+        {
+            auto after = lvl->getIllumination({4, 4}, Direction::UP);
+
+            REQUIRE(after.isLit({4, 1}));
+        }
+
+        AND_THEN("digging doesn't change the light")
+        {
+            lvl->setTile({4, 3}, TileType::EMPTY);
+
+            REQUIRE(lvl->getIllumination({4, 4}, Direction::LEFT).lit ==
+                    lvl->getIllumination({4, 4}, Direction::LEFT).lit);
+            REQUIRE(lvl->getIllumination({4, 4}, Direction::UP).isLit({4, 3}));
+        }
+    }
+
     WHEN("there are blocking stuff around")
     {
         THEN("the light is also blocked")
@@ -3,6 +3,21 @@
 #include <catch.hpp>
 #include <trompeloeil.hpp>
 
+#include <map>
+
+// Light up points close to the top left corner
+static Illumination lit(std::initializer_list<point> points)
+{
+    Illumination out;
+
+    for (auto &cur : points)
+    {
+        out.set(cur);
+    }
+
+    return out;
+}
+
 SCENARIO("Darkness is complete, but can be lighted")
 {
     GIVEN("a valid level with dirt")
@@ -50,9 +65,32 @@ SCENARIO("Darkness is complete, but can be lighted")
             }
         }
 
+        WHEN("the light moves")
+        {
+            lightning->updateLightning(lit({ {1,1}, {2, 1} }));
+            lightning->updateLightning(lit({ {2,1}, {3, 1} }));
+
+            THEN("the visibility map shows what's lit and what has been seen")
+            {
+                REQUIRE(!lightning->isLit({1,1}));
+                REQUIRE(lightning->isSeen({1,1}));
+                REQUIRE(lightning->isLit({2,1}));
+                REQUIRE(lightning->isLit({3,1}));
+                REQUIRE(!lightning->isSeen({4,1}));
+
+                // Out of bounds
+                REQUIRE(!lightning->isLit({-1,1}));
+                REQUIRE(!lightning->isSeen({9,1}));
+
+                REQUIRE(lightning->getLit().row(1)[0] == 0b1100);
+                REQUIRE(lightning->getSeen().row(1)[0] == 0b1110);
+                REQUIRE(lightning->getSeen().row(0)[0] == 0);
+            }
+        }
+
         WHEN("there is light over the dirt")
         {
-            lightning->updateLightning({ {1,1}, {2, 1} });
+            lightning->updateLightning(lit({ {1,1}, {2, 1} }));
 
             THEN("the dirt will become known")
             {
@@ -72,7 +110,7 @@ SCENARIO("Darkness is complete, but can be lighted")
 
         WHEN("a seen tile in the shadows is changed")
         {
-            lightning->updateLightning({ {1,1}, {2, 1} });
+            lightning->updateLightning(lit({ {1,1}, {2, 1} }));
 
             // change in darkness
             lvl->setTile({1,1}, TileType::STONE_WALL);
@@ -87,7 +125,7 @@ SCENARIO("Darkness is complete, but can be lighted")
 
             WHEN("it is lighted")
             {
-                lightning->updateLightning({ {1,1}, {2, 1} });
+                lightning->updateLightning(lit({ {1,1}, {2, 1} }));
 
                 THEN("it will be known again")
                 {
@@ -101,7 +139,7 @@ SCENARIO("Darkness is complete, but can be lighted")
 
         WHEN("there is light over entities")
         {
-            lightning->updateLightning({ {1,2} });
+            lightning->updateLightning(lit({ {1,2} }));
 
             THEN("they will be seen")
             {
@@ -118,7 +156,7 @@ SCENARIO("Darkness is complete, but can be lighted")
 
                 WHEN("the light changes and the entity is in the darkness")
                 {
-                    lightning->updateLightning({ {0,0} });
+                    lightning->updateLightning(lit({ {0,0} }));
 
                     THEN("it will be in the shadow entities")
                     {
@@ -137,7 +175,7 @@ SCENARIO("Darkness is complete, but can be lighted")
 
             WHEN("a known entity in the shadows is moved")
             {
-                lightning->updateLightning({});
+                lightning->updateLightning(lit({}));
 
                 auto visible = lightning->getVisibleEntities();
                 auto shadow = lightning->getShadowEntities();
@@ -156,7 +194,7 @@ SCENARIO("Darkness is complete, but can be lighted")
 
                 THEN("it will stay in the previous position in the shadows")
                 {
-                    lightning->updateLightning({{0,1}});
+                    lightning->updateLightning(lit({{0,1}}));
 
                     auto visible = lightning->getVisibleEntities();
                     auto shadow = lightning->getShadowEntities();
@@ -171,7 +209,7 @@ SCENARIO("Darkness is complete, but can be lighted")
 
                 AND_WHEN("the new position is lighted")
                 {
-                    lightning->updateLightning({{0,0}});
+                    lightning->updateLightning(lit({{0,0}}));
 
                     THEN("the entity will be seen at the new position")
                     {
@@ -194,3 +232,208 @@ SCENARIO("Darkness is complete, but can be lighted")
        }
     }
 }
+
+SCENARIO("Entities outside the light can be shown as shadows")
+{
+    auto store = IEntityStore::getInstance();
+
+    std::shared_ptr<ILevel> lvl = ILevel::fromString("9 3 "
+                                    "o........"
+                                    ".d......."
+                                    ".oo.....p");
+    REQUIRE(lvl);
+
+    auto lightning = ILightning::create(lvl);
+    lightning->setUnknownBehavior(ILightning::UnknownBehavior::SHOW);
+
+    // The entities which aren't lit, by position
+    auto expectedShadows = [&store, &lightning]()
+    {
+        std::map<point, EntityType> out;
+
+        store->forEachEntity([&out, &lightning](const std::shared_ptr<IEntity> &ent)
+        {
+            if (!lightning->isLit(ent->getPosition()))
+            {
+                out[ent->getPosition()] = ent->getType();
+            }
+        });
+
+        return out;
+    };
+    auto shadows = [&lightning]()
+    {
+        std::map<point, EntityType> out;
+
+        for (auto &cur : lightning->getShadowEntities())
+        {
+            out[cur.pt] = cur.type;
+        }
+
+        return out;
+    };
+
+    WHEN("there is light over some of them")
+    {
+        lightning->updateLightning(lit({ {1,1}, {1,2} }));
+
+        THEN("the others are in the shadows")
+        {
+            REQUIRE(lightning->getVisibleEntities().size() == 2);
+            REQUIRE(shadows().size() == 3);
+            REQUIRE(shadows() == expectedShadows());
+        }
+
+        AND_WHEN("they move, are removed and the light moves")
+        {
+            store->getEntityByPoint({0,0})->setPosition({0,1});
+            store->getEntityByPoint({2,2})->remove();
+            store->getEntityByPoint({1,2})->setPosition({3,2});
+            lightning->updateLightning(lit({ {0,1}, {2,2} }));
+
+            THEN("the shadows follow")
+            {
+                REQUIRE(lightning->getVisibleEntities().size() == 1);
+                REQUIRE(shadows() == expectedShadows());
+                REQUIRE(shadows().count({3,2}) == 1);
+                REQUIRE(shadows().count({1,1}) == 1);
+                REQUIRE(shadows().count({0,0}) == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("Seen tiles are remembered until seen again")
+{
+    std::shared_ptr<ILevel> lvl = ILevel::fromString("8 2 "
+                                    " .#w<>tt"
+                                    "......p.");
+    REQUIRE(lvl);
+
+    auto lightning = ILightning::create(lvl);
+
+    Illumination firstRow;
+    for (auto x = 0; x < 4; x++)
+    {
+        firstRow.set({x, 0});
+    }
+    lightning->updateLightning(firstRow);
+
+    // Change everything in the darkness
+    lightning->updateLightning(Illumination());
+    for (auto x = 0; x < 8; x++)
+    {
+        lvl->setTile({x, 0}, TileType::EMPTY);
+    }
+
+    REQUIRE(lightning->tileAt({0, 0}) == TileType::EMPTY);
+    REQUIRE(lightning->tileAt({1, 0}) == TileType::DIRT);
+    REQUIRE(lightning->tileAt({2, 0}) == TileType::STONE_WALL);
+    REQUIRE(lightning->tileAt({3, 0}) == TileType::WEAK_STONE_WALL);
+    REQUIRE(lightning->tileAt({4, 0}) == TileType::UNKNOWN);
+    REQUIRE(lightning->tileAt({3, 1}) == TileType::UNKNOWN);
+    REQUIRE(!lightning->tileAt({8, 0}));
+    REQUIRE(!lightning->tileAt({0, -1}));
+}
+
+SCENARIO("Fireballs and bombs light up their surroundings")
+{
+    auto store = IEntityStore::getInstance();
+
+    std::shared_ptr<ILevel> lvl = ILevel::fromString("9 5 "
+                                    "........."
+                                    "........."
+                                    "..b......"
+                                    "........."
+                                    "........p");
+    REQUIRE(lvl);
+
+    auto lightning = ILightning::create(lvl);
+    lightning->updateLightning(Illumination());
+
+    THEN("the light fades with the distance from the bomb")
+    {
+        REQUIRE(lightning->getLightLevel({2,2}) == ILightning::LIGHT_FULL);
+        REQUIRE(lightning->getLightLevel({3,3}) == 2);
+        REQUIRE(lightning->getLightLevel({0,4}) == 1);
+        REQUIRE(lightning->getLightLevel({5,2}) == 0);
+        REQUIRE(lightning->getLightLevel({-1,2}) == 0);
+    }
+
+    WHEN("the bomb moves and a fireball is created next to it")
+    {
+        store->getEntityByPoint({2,2})->setPosition({3,2});
+        store->spawnBatch({{EntityType::FIREBALL, {5,2}}});
+        lightning->updateLightning(Illumination());
+
+        THEN("the light follows and adds up")
+        {
+            REQUIRE(lightning->getLightLevel({1,2}) == 1);
+            REQUIRE(lightning->getLightLevel({0,2}) == 0);
+            REQUIRE(lightning->getLightLevel({3,2}) == ILightning::LIGHT_FULL);
+            REQUIRE(lightning->getLightLevel({4,2}) == ILightning::LIGHT_FULL); // 2 + 2
+            REQUIRE(lightning->getLightLevel({7,2}) == 1);
+        }
+
+        AND_WHEN("the light sources go out")
+        {
+            store->getEntityByPoint({3,2})->remove();
+            store->getEntityByPoint({5,2})->remove();
+            store->destroyRemoved();
+            lightning->updateLightning(Illumination());
+
+            THEN("it's dark again")
+            {
+                for (auto x = 0; x < 9; x++)
+                {
+                    REQUIRE(lightning->getLightLevel({x,2}) == 0);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Shadows are correct after switching to showing the unknown")
+{
+    auto store = IEntityStore::getInstance();
+
+    std::shared_ptr<ILevel> lvl = ILevel::fromString("9 3 "
+                                    "o........"
+                                    "........."
+                                    "........p");
+    REQUIRE(lvl);
+
+    auto lightning = ILightning::create(lvl);
+
+    GIVEN("an entity which was seen and then moved in the dark")
+    {
+        lightning->updateLightning(lit({ {0,0} }));
+        lightning->updateLightning(lit({ {4,1} }));
+
+        // Remembered where it was seen
+        REQUIRE(lightning->getShadowEntities().size() == 1);
+        REQUIRE(lightning->getShadowEntities().front().pt == (point){0,0});
+
+        store->getEntityByPoint({0,0})->setPosition({2,0});
+
+        WHEN("switching to showing the unknown")
+        {
+            lightning->setUnknownBehavior(ILightning::UnknownBehavior::SHOW);
+            lightning->updateLightning(lit({ {4,1} }));
+
+            THEN("only the entities where they are now are in the shadows")
+            {
+                std::map<point, EntityType> shadows;
+                for (auto &cur : lightning->getShadowEntities())
+                {
+                    shadows[cur.pt] = cur.type;
+                }
+
+                REQUIRE(shadows.size() == 2);
+                REQUIRE(shadows.count({0,0}) == 0);
+                REQUIRE(shadows[{2,0}] == EntityType::BOULDER);
+                REQUIRE(shadows[{8,2}] == EntityType::PLAYER);
+            }
+        }
+    }
+}
@@ -2,6 +2,10 @@
 #include <trompeloeil.hpp>
 
 #include <observer.hh>
+#include <entity.hh>
+
+#include <chrono>
+#include <cstdio>
 
 TEST_CASE("The notifier can be created")
 {
@@ -102,3 +106,159 @@ TEST_CASE("argument notifiers")
         // Should not crash
     }
 }
+
+TEST_CASE("variadic notifiers")
+{
+    auto n = std::make_shared<Notifier<int, std::string>>();
+
+    SECTION("arguments are passed by reference")
+    {
+        std::string str = "lorminator";
+        const std::string *seen = nullptr;
+
+        auto cookie = n->listen([&seen](const int &a, const std::string &s){ seen = &s; });
+
+        n->invoke(1, str);
+        REQUIRE(seen == &str);
+    }
+
+    SECTION("more listeners than fit inline can listen")
+    {
+        std::vector<std::unique_ptr<ObserverCookie>> cookies;
+        unsigned calls = 0;
+
+        for (unsigned i = 0; i < 8; i++)
+        {
+            cookies.push_back(n->listen([&calls](const int &, const std::string &){ calls++; }));
+        }
+
+        n->invoke(1, "a");
+        REQUIRE(calls == 8U);
+
+        // Remove from the inline part and the rest
+        cookies[0].reset();
+        cookies[5].reset();
+
+        n->invoke(1, "a");
+        REQUIRE(calls == 14U);
+    }
+
+    SECTION("listeners past the inline ones can listen while invoking")
+    {
+        std::vector<std::unique_ptr<ObserverCookie>> cookies;
+        unsigned calls = 0;
+        unsigned added = 0;
+
+        auto grow = [&](unsigned count)
+        {
+            for (unsigned i = 0; i < count; i++)
+            {
+                cookies.push_back(n->listen([&added](const int &, const std::string &){ added++; }));
+            }
+            calls++;
+        };
+
+        cookies.push_back(n->listen([&calls](const int &, const std::string &){ calls++; }));
+        cookies.push_back(n->listen([&calls](const int &, const std::string &){ calls++; }));
+        // Small enough to be kept within the listener itself
+        cookies.push_back(n->listen([&grow](const int &, const std::string &)
+        {
+            // Enough to make the overflow listeners grow, and then touch the callback again
+            grow(64);
+            grow(0);
+        }));
+
+        n->invoke(1, "a");
+        // The new ones are called from the next invocation on
+        REQUIRE(calls == 4U);
+        REQUIRE(added == 0U);
+
+        n->invoke(1, "a");
+        REQUIRE(calls == 8U);
+        REQUIRE(added == 64U);
+    }
+
+    SECTION("ids are not reused")
+    {
+        unsigned a = 0;
+        unsigned b = 0;
+
+        auto ca = n->listen([&a](const int &, const std::string &){ a++; });
+        auto cb = n->listen([&b](const int &, const std::string &){ b++; });
+
+        ca.reset();
+        auto cc = n->listen([&a](const int &, const std::string &){ a++; });
+
+        // Detaching cb must not touch the listener which took the place of ca
+        cb.reset();
+        n->invoke(1, "a");
+
+        REQUIRE(a == 1U);
+        REQUIRE(b == 0U);
+    }
+
+    SECTION("listeners can be removed from nested invocations")
+    {
+        std::vector<std::unique_ptr<ObserverCookie>> cookies;
+        unsigned calls = 0;
+
+        cookies.push_back(n->listen([&](const int &depth, const std::string &s)
+        {
+            calls++;
+            if (depth == 0)
+            {
+                n->invoke(1, s);
+                cookies[1].reset();
+            }
+        }));
+        cookies.push_back(n->listen([&calls](const int &, const std::string &){ calls++; }));
+
+        n->invoke(0, "a");
+        // Outer: only the first, since the second was removed before its turn, inner: both
+        REQUIRE(calls == 3U);
+
+        n->invoke(1, "a");
+        REQUIRE(calls == 4U);
+    }
+}
+
+// Not run by default: ut "[.bench]"
+TEST_CASE("Observer cost per setPosition", "[.bench]")
+{
+    const unsigned rounds = 1000000;
+    unsigned moves = 0;
+
+    auto nsPerRound = [](std::chrono::steady_clock::time_point start)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+        return (double)ns.count() / rounds;
+    };
+
+    // Two listeners, like the animator and the behaviors of an entity
+    Notifier2<point, point> notifier;
+    auto c1 = notifier.listen([&moves](const point &, const point &){ moves++; });
+    auto c2 = notifier.listen([&moves](const point &, const point &){ moves++; });
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < rounds; i++)
+    {
+        notifier.invoke({(int)i & 1, 0}, {1 - ((int)i & 1), 0});
+    }
+    printf("Notifier2 invoke: %.1f ns\n", nsPerRound(start));
+
+    auto store = IEntityStore::getInstance();
+    store->setSize({2, 1});
+    auto entity = IEntity::createFromChar('o', {0,0});
+    auto e1 = entity->onMovement([&moves](const std::shared_ptr<IEntity> &, const point &, const point &){ moves++; });
+    auto e2 = entity->onMovement([&moves](const std::shared_ptr<IEntity> &, const point &, const point &){ moves++; });
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < rounds; i++)
+    {
+        entity->setPosition({1 - ((int)i & 1), 0});
+    }
+    printf("setPosition with two movement listeners: %.1f ns\n", nsPerRound(start));
+
+    REQUIRE(moves == 4 * rounds);
+}
@@ -0,0 +1,98 @@
+#include <catch.hpp>
+#include <trompeloeil.hpp>
+
+#include <pool.hh>
+
+#include <memory>
+#include <vector>
+
+namespace
+{
+class Pooled : public PoolAllocated
+{
+public:
+    virtual ~Pooled()
+    {
+    }
+
+    uint64_t m_data[3];
+};
+
+class LargerPooled : public Pooled
+{
+public:
+    uint64_t m_moreData[8];
+};
+}
+
+SCENARIO("objects can be allocated from the block pools")
+{
+    WHEN("an object is freed and another of the same size allocated")
+    {
+        auto first = new Pooled();
+        auto firstAddress = (void *)first;
+        delete first;
+
+        auto before = BlockPool::getStats();
+        auto second = new Pooled();
+
+        THEN("the memory is reused without a new slab")
+        {
+            auto after = BlockPool::getStats();
+
+            REQUIRE((void *)second == firstAddress);
+            REQUIRE(after.hits == before.hits + 1);
+            REQUIRE(after.slabs == before.slabs);
+        }
+        delete second;
+    }
+
+    WHEN("derived objects are deleted through the base class")
+    {
+        std::vector<std::unique_ptr<Pooled>> objects;
+
+        for (unsigned i = 0; i < 1000; i++)
+        {
+            objects.push_back(std::make_unique<LargerPooled>());
+            objects.push_back(std::make_unique<Pooled>());
+        }
+        objects.clear();
+
+        THEN("the blocks are returned to the right pool and reused")
+        {
+            auto before = BlockPool::getStats();
+
+            for (unsigned i = 0; i < 1000; i++)
+            {
+                objects.push_back(std::make_unique<LargerPooled>());
+            }
+            auto after = BlockPool::getStats();
+
+            REQUIRE(after.slabs == before.slabs);
+            REQUIRE(after.hits == before.hits + 1000);
+        }
+    }
+
+    WHEN("shared objects are allocated with the pool allocator")
+    {
+        auto p = std::allocate_shared<std::vector<int>>(PoolAllocator<std::vector<int>>(), 3, 7);
+
+        THEN("they work as usual")
+        {
+            REQUIRE(p->size() == 3);
+            REQUIRE((*p)[2] == 7);
+        }
+    }
+
+    WHEN("objects too large for the pools are allocated")
+    {
+        auto before = BlockPool::getStats();
+        auto p = BlockPool::allocate(4096);
+
+        THEN("they are counted as misses")
+        {
+            REQUIRE(BlockPool::getStats().misses == before.misses + 1);
+        }
+        BlockPool::deallocate(p, 4096);
+    }
+}
@@ -0,0 +1,117 @@
+#include <catch.hpp>
+#include <trompeloeil.hpp>
+
+#include <timer-wheel.hh>
+
+#include <algorithm>
+#include <vector>
+
+SCENARIO("Timers expire at their deadlines")
+{
+    TimerWheel<int> wheel;
+    std::vector<int> expired;
+
+    WHEN("timers are scheduled at different distances")
+    {
+        // Different levels of the wheel
+        wheel.schedule(5, 1);
+        wheel.schedule(64, 2);
+        wheel.schedule(100, 3);
+        wheel.schedule(5000, 4);
+        wheel.schedule(300000, 5);
+        wheel.schedule(20000000, 6); // Beyond the wheel
+        REQUIRE(wheel.size() == 6);
+
+        THEN("each expires when the time has passed its deadline, and not before")
+        {
+            const std::vector<std::pair<uint64_t, int>> deadlines =
+            {
+                {5, 1}, {64, 2}, {100, 3}, {5000, 4}, {300000, 5}, {20000000, 6},
+            };
+
+            for (auto &cur : deadlines)
+            {
+                wheel.advance(cur.first - 1, expired);
+                REQUIRE(std::find(expired.begin(), expired.end(), cur.second) == expired.end());
+
+                wheel.advance(cur.first, expired);
+                REQUIRE(expired.back() == cur.second);
+            }
+            REQUIRE(expired.size() == 6);
+            REQUIRE(wheel.size() == 0);
+        }
+    }
+
+    WHEN("the time is advanced in large steps")
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            wheel.schedule(i * 37 + 1, i);
+        }
+
+        wheel.advance(160, expired);
+        REQUIRE(expired.size() == 5); // 1, 38, 75, 112, 149
+
+        wheel.advance(10000, expired);
+
+        THEN("all have expired")
+        {
+            REQUIRE(expired.size() == 100);
+            REQUIRE(wheel.size() == 0);
+        }
+    }
+
+    WHEN("many timers are scheduled while the time advances")
+    {
+        std::vector<uint64_t> deadlines;
+        uint64_t now = 0;
+        unsigned seed = 1;
+        auto rnd = [&seed]()
+        {
+            seed = seed * 1103515245 + 12345;
+            return (seed >> 8) & 0xffff;
+        };
+
+        for (int round = 0; round < 2000; round++)
+        {
+            auto deadline = now + rnd() * (round % 3 == 0 ? 64 : 1);
+
+            wheel.schedule(deadline, (int)deadlines.size());
+            deadlines.push_back(deadline);
+
+            auto last = now;
+
+            expired.clear();
+            now += rnd() % 500;
+            wheel.advance(now, expired);
+
+            for (auto id : expired)
+            {
+                // Expired, but not already at the last advance (unless just scheduled)
+                REQUIRE(deadlines[id] <= now);
+                REQUIRE((deadlines[id] > last || id == (int)deadlines.size() - 1));
+                deadlines[id] = UINT64_MAX;
+            }
+        }
+
+        THEN("none are left behind")
+        {
+            for (auto deadline : deadlines)
+            {
+                REQUIRE((deadline == UINT64_MAX || deadline > now));
+            }
+        }
+    }
+
+    WHEN("a timer is scheduled in the past")
+    {
+        wheel.advance(1000, expired);
+        wheel.schedule(10, 1);
+
+        THEN("it expires at the next advance")
+        {
+            wheel.advance(1001, expired);
+            REQUIRE(expired.size() == 1);
+        }
+    }
+}
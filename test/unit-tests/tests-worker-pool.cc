@@ -0,0 +1,43 @@
+#include <catch.hpp>
+#include <trompeloeil.hpp>
+
+#include <worker-pool.hh>
+
+#include <vector>
+
+SCENARIO("Work is split into stripes")
+{
+    for (unsigned threads : {1U, 3U, 8U})
+    {
+        auto workers = IWorkerPool::create(threads);
+        REQUIRE(workers->getThreadCount() == threads);
+
+        WHEN("the work is done by " + std::to_string(threads) + " threads")
+        {
+            THEN("each item is handled exactly once")
+            {
+                for (size_t count : {0U, 1U, 5U, 1000U})
+                {
+                    std::vector<int> handled(count);
+
+                    for (auto round = 0; round < 20; round++)
+                    {
+                        // Catch isn't thread-safe, so only count here
+                        workers->forEachStripe(count, [&handled](size_t first, size_t last)
+                        {
+                            for (auto i = first; i < last; i++)
+                            {
+                                handled[i]++;
+                            }
+                        });
+                    }
+
+                    for (auto cur : handled)
+                    {
+                        REQUIRE(cur == 20);
+                    }
+                }
+            }
+        }
+    }
+}